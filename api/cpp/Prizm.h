@@ -2,13 +2,53 @@
 #define PRIZM_API
 
 // @TODO Minimize C++ STL dependencies
+#include <algorithm> // std::stable_sort, std::min, std::max
+#include <atomic>
+#include <charconv> // std::to_chars
+#include <condition_variable>
+#include <csignal> // std::signal, std::raise
+#include <cmath> // std::trunc, std::signbit
+#include <cstdlib> // std::realloc, std::free
+#include <cstring> // std::memcpy
+#include <deque>
 #include <fstream>
 #include <iomanip>
 #include <limits>
+#include <memory> // std::unique_ptr
+#include <memory_resource> // std::pmr::memory_resource
+#include <mutex>
+#include <new> // Placement new, used by the Obj move assignment
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <thread> // std::this_thread::get_id
 #include <type_traits>
+#include <unordered_map>
+#include <utility> // std::swap
+#include <vector>
 #include <stdarg.h> // va_arg, va_list, va_end
+#include <fcntl.h> // open, FlightRecorder writes files in signal handlers so it can't use std::ofstream
+#ifdef _WIN32
+#include <io.h> // _open, _write, _close
+#include <sys/stat.h> // _S_IREAD, _S_IWRITE
+#else
+#include <signal.h> // sigaction, used by FlightRecorder
+#include <sys/uio.h> // writev, used by Obj::write
+#include <unistd.h> // write, close
+#endif
+#ifdef _MSC_VER
+#include <intrin.h> // _BitScanForward64, used by Lz4Encoder
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PRIZM_SSE2
+#include <emmintrin.h> // Used by DecimalKernel
+#endif
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__)) && !defined(__AVX2__)
+#define PRIZM_AVX2_DISPATCH
+#endif
+#if defined(PRIZM_AVX2_DISPATCH) || defined(__AVX2__)
+#include <immintrin.h> // Used by DecimalKernel and ShortestKernel, AVX2 functions have a target attribute if needed
+#endif
 
 // The following are only used in the documentation() function
 #include <iostream> // std::cout
@@ -24,8 +64,6 @@ struct Vec2 {
     Vec2() : x(0), y(0) {}
     Vec2(T x, T y) : x(x), y(y) {}
 
-    template <typename T> friend std::ostream& operator<<(std::ostream& os, const Vec2<T>& v);
-
 #ifdef PRIZM_VEC2_CLASS_EXTRA
     PRIZM_VEC2_CLASS_EXTRA
 #endif
@@ -44,8 +82,6 @@ struct Vec3 {
     Vec3() : x(0), y(0), z(0) {}
     Vec3(T x, T y, T z) : x(x), y(y), z(z) {}
 
-    template <typename T> friend std::ostream& operator<<(std::ostream& os, const Vec3<T>& v);
-
 #ifdef PRIZM_VEC3_CLASS_EXTRA
     PRIZM_VEC3_CLASS_EXTRA
 #endif
@@ -64,8 +100,6 @@ struct Vec4 {
     Vec4() : x(0), y(0), z(0), w(0) {}
     Vec4(T x, T y, T z, T w) : x(x), y(y), z(z), w(w) {}
 
-    template <typename T> friend std::ostream& operator<<(std::ostream& os, const Vec4<T>& v);
-
 #ifdef PRIZM_VEC4_CLASS_EXTRA
     PRIZM_VEC4_CLASS_EXTRA
 #endif
@@ -78,12 +112,10 @@ template <typename T> std::ostream& operator<<(std::ostream& os, const Vec4<T>&
 
 // A linear color type. Use PRIZM_COLOR_CLASS_EXTRA to define additional constructors and implicit casts to your types
 struct Color {
-    union { struct { uint8_t r, g, b; }; uint8_t rgba[3]; };
+    union { struct { uint8_t r, g, b, a; }; uint8_t rgba[4]; };
 
-    Color() : r(0), g(0), b(0) {}
-    Color(uint8_t r, uint8_t g, uint8_t b) : r(r), g(g), b(b) {}
-
-    friend std::ostream& operator<<(std::ostream& os, const Color& v);
+    Color() : r(0), g(0), b(0), a(255) {}
+    Color(uint8_t r, uint8_t g, uint8_t b, uint8_t a = 255) : r(r), g(g), b(b), a(a) {}
 
 #ifdef PRIZM_COLOR_CLASS_EXTRA
     PRIZM_COLOR_CLASS_EXTRA
@@ -92,7 +124,7 @@ struct Color {
 
 std::ostream& operator<<(std::ostream& os, const Color& v) {
     // Cast to int so we don't write chars
-    os << (int)v.r << ' ' << (int)v.g << ' ' << (int)v.b;
+    os << (int)v.r << ' ' << (int)v.g << ' ' << (int)v.b << ' ' << (int)v.a;
     return os;
 }
 
@@ -118,1291 +150,4847 @@ const Color MAGENTA{255, 0, 255};
 const Color YELLOW{255, 255, 0};
 
 
-// An example using the API and an explanation of the rationale behind it.
-// Returns boolean to indicate if the documentation tests pass
-bool documentation(bool write_files = false);
-
-//
-// Writes OBJ files and Prizm-specific extensions.
-//
-// See the Prizm::documentation() function for a demo of the API, although it should be self-explanatory.
-//
-// The following page was the reference for the OBJ format: http://paulbourke.net/dataformats/obj/
-// (not everything on that page is implemented). Note Prizm-specific extensions are designed so that
-// OBJ files containing such extensions will always open in other OBJ viewers.
-//
-// You can extend this class by defining a PRIZM_OBJ_CLASS_EXTRA macro, this is mostly useful if
-// you want to add functions chain calls (i.e., obj.function1().function2()). If you don't care
-// about this you can make a regular function
-//
-struct Obj {
-
-    //
-    // State
-    //
-
-    // Current contents of the OBJ file
-    std::stringstream obj;
-
-    // Number of hash characters on the current line, these are significant for Prizm:
-    // 0 hash characters => writing geometry
-    // 1 hash character  => writing an annotation. Prizm stores the text between the first hash and a newline/second hash as an annotation
-    // 2 hash characters => writing a comment. Prizm ignores everything following the second hash character on a line
-    unsigned hash_count = 0;
-
-    // Number of v-directives written to `obj`
-    unsigned v_count = 0;
-
-    // Number of vn-directives written to `obj`
-    unsigned vn_count = 0;
-
-    // Number of vt-directives written to `obj`
-    unsigned vt_count = 0;
-
-    // If true (default) then functions where the user has not explicity passed indices will use negative indices to refer to vertex data
-    // If false then the the above counts will be used to use positive indices when referring to vertex data.
-    //
-    // Using negative indices is the default because it means the Obj can be concatenated with other Objs (which
-    // must also be using negative indices) to write a single file (see Prizm::Obj::append). The downsides of doing
-    // this is are i) the obj file may not load in viewers other than Prizm since negative indices seem not to be
-    // well supported, and ii) triangles are written as a disconnected soup which increases file size due to
-    // duplicated vertex data
-    bool use_negative_indices = true;
-
-
+// Recycles the memory of destroyed Buffers on the calling thread, so programs which create many short-lived Objs do
+// no heap allocations in steady state. Only buffers allocated with malloc (i.e., not using a memory resource, see
+// Buffer) are recycled. Use local() to change the limits for the calling thread, set `max_buffers` to 0 to disable it
+struct BufferPool {
+    struct Block {
+        char* data = nullptr;
+        size_t capacity = 0;
+    };
 
-    //
-    // Basic functions
-    //
+    std::vector<Block> blocks;
+    size_t max_buffers = 8; // Maximum number of buffers kept
+    size_t max_capacity = size_t(1) << 20; // Larger buffers are freed rather than kept
 
-    // Constructor. By default write with enough precision to round-trip from float64 to decimal and back
-    // Note: Prizm currently stores mesh data using float32, we will move to float64 so we can show coordinate labels at full precision
-    Obj() {
-        set_precision();
-    }
+    BufferPool() {}
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
 
-    // Add anything to the OBJ file using operator<<
-    template <typename T> Obj& add(const T& anything) {
-        obj << anything;
-        return *this;
+    ~BufferPool() {
+        for (Block& block : blocks) std::free(block.data);
+        destroyed() = true;
     }
 
-    // Add anything to the OBJ file using operator<< but prefix with a space character
-    template <typename T> Obj& insert(const T& anything) {
-        return space().add(anything);
+    // Returns a recycled block, which is empty if there is none
+    Block take() {
+        Block block;
+        if (!blocks.empty()) {
+            block = blocks.back();
+            blocks.pop_back();
+        }
+        return block;
     }
 
-    // Add a newline, then add the `other` Obj and then add another newline
-    // Note: `other` must exclusively use negative (aka relative) indices
-    Obj& append(const Obj& other) {
-        std::basic_stringbuf<char,std::char_traits<char>,std::allocator<char>>* buf = other.obj.rdbuf();
-        if (buf) {
-            newline().add(buf).newline();
+    // Keep the block for reuse, or free it if the pool is full
+    void give(Block block) {
+        if (blocks.size() < max_buffers && block.capacity <= max_capacity) {
+            blocks.push_back(block);
+        } else {
+            std::free(block.data);
         }
-        return *this;
     }
 
+    // Returns the calling thread's pool, or nullptr if it has been destroyed because the thread is exiting
+    static BufferPool* local() {
+        if (destroyed()) return nullptr;
+        thread_local BufferPool pool;
+        return &pool;
+    }
 
+    static bool& destroyed() {
+        thread_local bool value = false; // Trivially destructible, so valid while the thread's pool is destroyed
+        return value;
+    }
+};
 
+// Runs the chunks of large Obj bulk writes (see Obj::set_thread_count) on worker threads which are started the first
+// time they are needed and then reused, so a bulk write doesn't pay for creating and joining threads. The pool is
+// shared by all Objs, it grows to the largest number of workers requested and its threads are joined at exit
+struct WorkerPool {
+    struct Task {
+        void (*function)(void* context, int index) = nullptr;
+        void* context = nullptr;
+        int index = 0;
+        int* remaining = nullptr; // Number of unfinished tasks queued by the same run() call, guarded by `mutex`
+    };
 
+    std::mutex mutex;
+    std::condition_variable task_added; // Signalled when tasks are queued or when stopping
+    std::condition_variable task_done; // Signalled when the last task of a run() call is finished
+    std::deque<Task> tasks;
+    std::vector<std::thread> threads;
+    bool stopping = false;
+
+    WorkerPool() {}
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        task_added.notify_all();
+        for (std::thread& thread : threads) thread.join();
+    }
+
+    // Call `function(i)` for each i in [0, count) concurrently and return when all the calls have returned. The
+    // calling thread makes the last call, so `count - 1` workers are used
+    template <typename Function> void run(int count, Function& function) {
+        if (count <= 0) return;
+        int remaining = count - 1;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            while (threads.size() < static_cast<size_t>(count - 1)) {
+                threads.emplace_back([this]() { work(); });
+            }
+            auto call = [](void* context, int index) { (*static_cast<Function*>(context))(index); };
+            for (int i = 0; i < count - 1; i++) {
+                tasks.push_back(Task{call, &function, i, &remaining});
+            }
+        }
+        task_added.notify_all();
+        function(count - 1);
+        std::unique_lock<std::mutex> lock(mutex);
+        task_done.wait(lock, [&]() { return remaining == 0; });
+    }
+
+    // The worker thread loop
+    void work() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            task_added.wait(lock, [&]() { return stopping || !tasks.empty(); });
+            if (tasks.empty()) {
+                return;
+            }
+            Task task = tasks.front();
+            tasks.pop_front();
+            lock.unlock();
+            task.function(task.context, task.index);
+            lock.lock();
+            if (--*task.remaining == 0) {
+                task_done.notify_all();
+            }
+        }
+    }
 
-    //
-    // Output functions
-    //
+    // The pool used by every Obj
+    static WorkerPool& shared() {
+        static WorkerPool pool;
+        return pool;
+    }
+};
 
-    // Write data to a file
-    //
-    // Tip: Use format string "%05d" to write an int padded with zeros to width 5. This is useful for logging the
-    // progress of an algorithm, you will also need to use the same prefix and you may need to run the
-    // `sort_by_name` console command in Prizm to put the item list into a state where you can use Ctrl LMB or
-    // Shift LMB while sweeping the cursor over the visibility checkboxes to create a progress animation.
-    Obj& write(std::string filename) {
-        std::ofstream file;
-        file.open(filename, std::ofstream::out | std::ofstream::trunc);
-        file << obj.str();
-        file.close();
-        return *this;
+// A growable contiguous byte buffer, this is where Prizm::Obj accumulates the text of the OBJ file. Numbers are
+// formatted directly into the spare capacity at the end of the buffer (see Buffer::reserve and Buffer::commit)
+//
+// By default memory is allocated with malloc and recycled using the thread's BufferPool. If `resource` is set memory
+// is allocated from it instead e.g., from a std::pmr::monotonic_buffer_resource or a custom arena deriving from
+// std::pmr::memory_resource. Like std::pmr containers, copies use malloc and moves take the resource with the memory
+struct Buffer {
+    char* data = nullptr;
+    size_t count = 0;
+    size_t capacity = 0;
+    std::pmr::memory_resource* resource = nullptr;
+
+    Buffer() {}
+    explicit Buffer(std::pmr::memory_resource* resource) : resource(resource) {}
+    Buffer(const Buffer& other) { append(other.data, other.count); }
+    Buffer(Buffer&& other) noexcept { swap(other); }
+    Buffer& operator=(Buffer other) noexcept { swap(other); return *this; }
+    ~Buffer() { release(); }
+
+    void swap(Buffer& other) noexcept {
+        std::swap(data, other.data);
+        std::swap(count, other.count);
+        std::swap(capacity, other.capacity);
+        std::swap(resource, other.resource);
+    }
+
+    // Ensure there is space for at least n more bytes and return a pointer to the first unused byte
+    char* reserve(size_t n) {
+        if (count + n > capacity) {
+            grow(count + n);
+        }
+        return data + count;
     }
 
-    // Returns the current state of the Obj as a std::string
-    std::string to_std_string() const {
-        return obj.str();
+    // Mark the first n bytes following the pointer returned by reserve as used
+    void commit(size_t n) {
+        count += n;
     }
 
+    void append(const char* bytes, size_t n) {
+        if (n == 0) return;
+        std::memcpy(reserve(n), bytes, n);
+        count += n;
+    }
 
+    void append(char c) {
+        *reserve(1) = c;
+        count += 1;
+    }
 
+    void clear() {
+        count = 0;
+    }
 
     //
-    // Directives and special characters/strings
+    // Implementation methods
     //
 
-    // Add a vertex directive to start a vertex on a new line
-    Obj& v() {
-        v_count += 1;
-        return newline().add('v');
-    }
+    void grow(size_t min_capacity) {
+        if (!data && !resource) {
+            if (BufferPool* pool = BufferPool::local()) {
+                BufferPool::Block block = pool->take();
+                data = block.data;
+                capacity = block.capacity;
+                if (capacity >= min_capacity) return;
+            }
+        }
 
-    // Add a vertex normal directive on a new line
-    Obj& vn() {
-        vn_count += 1;
-        return newline().add("vn");
+        size_t new_capacity = capacity ? capacity : 4096;
+        while (new_capacity < min_capacity) new_capacity *= 2;
+        if (resource) {
+            char* new_data = static_cast<char*>(resource->allocate(new_capacity, 1));
+            if (count) std::memcpy(new_data, data, count);
+            if (data) resource->deallocate(data, capacity, 1);
+            data = new_data;
+        } else {
+            data = static_cast<char*>(std::realloc(data, new_capacity));
+        }
+        capacity = new_capacity;
     }
 
-    // Add a texture vertex directive on a new line
-    Obj& vt() {
-        vt_count += 1;
-        return newline().add("vt");
+    void release() {
+        if (!data) return;
+        if (resource) {
+            resource->deallocate(data, capacity, 1);
+        } else if (BufferPool* pool = BufferPool::local()) {
+            pool->give({data, capacity});
+        } else {
+            std::free(data);
+        }
+        data = nullptr;
+        count = capacity = 0;
     }
+};
 
-    // Add a point directive to start a point on a new line
-    Obj& p() {
-        return newline().add('p');
+// Compresses text to the LZ4 frame format (https://github.com/lz4/lz4/blob/dev/doc/lz4_Frame_format.md), this is
+// used by Prizm::Obj when the filename ends with ".lz4". The output can be loaded by the Prizm viewer or decompressed
+// with the lz4 command line tool. Blocks are compressed independently with a greedy single-probe matcher, which makes
+// typical debug output (repeated directives, annotations and round coordinates) 3-5x smaller at several hundred MB/s.
+// Full precision coordinates compress less, consider also using Obj::set_quantization
+struct Lz4Encoder {
+    static constexpr size_t max_block_size = 4 << 20; // The block maximum size written in the frame descriptor
+
+    Buffer frame; // Compressed bytes which have not been written yet
+    Buffer pending; // Text which has not been compressed yet, less than max_block_size bytes
+    std::vector<uint32_t> table; // Maps hashes of 4-byte sequences to their position in the block plus one
+
+    // Starts the frame by writing the frame header
+    Lz4Encoder() {
+        const uint8_t header[7] = {
+            0x04, 0x22, 0x4D, 0x18, // Magic number
+            0x60, // FLG: version 01, independent blocks, no checksums or content size
+            0x70, // BD: 4 MB maximum block size
+            0x73}; // HC: (xxh32 of FLG and BD) >> 8
+        frame.append(reinterpret_cast<const char*>(header), sizeof(header));
+    }
+
+    // Add text to the frame, compressing each full block
+    void add(const char* data, size_t count) {
+        while (count > 0) {
+            size_t n = std::min(count, max_block_size - pending.count);
+            pending.append(data, n);
+            data += n;
+            count -= n;
+            if (pending.count == max_block_size) end_block();
+        }
     }
 
-    // Add a line directive to start a segment/polyline on a new line
-    Obj& l() {
-        return newline().add('l');
+    // Compress the pending text, if any, to a block. Call this to make the text decompressible before the frame ends
+    void end_block() {
+        if (pending.count == 0) return;
+        frame.reserve(4 + pending.count + pending.count / 255 + 16); // Enough for the worst case
+        frame.append("\0\0\0\0", 4); // Block size, written below
+        size_t begin = frame.count;
+        compress_block(reinterpret_cast<const uint8_t*>(pending.data), pending.count);
+        uint32_t block_size = static_cast<uint32_t>(frame.count - begin);
+        if (block_size >= pending.count) {
+            // Incompressible, store the text with the high bit of the block size set
+            frame.count = begin;
+            frame.append(pending.data, pending.count);
+            block_size = static_cast<uint32_t>(pending.count) | 0x80000000u;
+        }
+        uint8_t* size = reinterpret_cast<uint8_t*>(frame.data + begin - 4);
+        for (int b = 0; b < 4; b++) size[b] = static_cast<uint8_t>(block_size >> (8 * b));
+        pending.clear();
     }
 
-    // Add a face directive to start a triangle/polygon on a new line
-    Obj& f() {
-        return newline().add('f');
+    // Compress the pending text and end the frame
+    void end_frame() {
+        end_block();
+        frame.append("\0\0\0\0", 4); // EndMark
     }
 
-    // Add a group directive on the current line
-    // Note: Currently Prizm ignores these
-    Obj& g() {
-        return newline().add('g');
-    }
+    //
+    // Implementation methods
+    //
 
-    // Add a newline to the obj and reset hash_count
-    Obj& newline(int count = 1) {
-        while (count > 0) {
-            hash_count = 0;
-            add("\n");
-            count -= 1;
-        }
-        return *this;
-    }
+    template <typename Int> static Int read(const uint8_t* p) {
+        Int value;
+        std::memcpy(&value, p, sizeof(Int));
+        return value;
+    }
+
+    static uint8_t* write_length(uint8_t* out, size_t length) {
+        for (; length >= 255; length -= 255) *out++ = 255;
+        *out++ = static_cast<uint8_t>(length);
+        return out;
+    }
+
+    // Write a sequence: `literal_count` literals starting at `literals`, then a match of `match_length` bytes at
+    // `offset` bytes before the current position, if match_length is not 0. Returns the end of the written bytes
+    static uint8_t* write_sequence(uint8_t* out, const uint8_t* literals, size_t literal_count, size_t offset, size_t match_length) {
+        size_t match_code = match_length ? match_length - 4 : 0;
+        *out++ = static_cast<uint8_t>(std::min<size_t>(literal_count, 15) << 4 | std::min<size_t>(match_code, 15));
+        if (literal_count >= 15) out = write_length(out, literal_count - 15);
+        std::memcpy(out, literals, literal_count);
+        out += literal_count;
+        if (match_length == 0) return out;
+        *out++ = static_cast<uint8_t>(offset & 0xFF);
+        *out++ = static_cast<uint8_t>(offset >> 8);
+        if (match_code >= 15) out = write_length(out, match_code - 15);
+        return out;
+    }
+
+    // Compress `count` bytes to the end of `frame`, which must have space for the worst case, see end_block
+    void compress_block(const uint8_t* src, size_t count) {
+        constexpr int hash_bits = 16;
+        constexpr size_t max_offset = 65535;
+        constexpr size_t last_literals = 5; // The format requires the last 5 bytes to be literals...
+        constexpr size_t match_start_limit = 12; // ...and the last match to start at least 12 bytes before the end
+        table.assign(size_t(1) << hash_bits, 0);
+
+        uint8_t* first = reinterpret_cast<uint8_t*>(frame.data + frame.count);
+        uint8_t* out = first;
+        size_t anchor = 0; // Start of the literals which have not been written
+        size_t i = 0;
+        size_t misses = 0; // Like the reference encoder, skip ahead faster in data which doesn't compress
+        while (count > match_start_limit && i < count - match_start_limit) {
+            uint32_t sequence = read<uint32_t>(src + i);
+            uint32_t hash = (sequence * 2654435761u) >> (32 - hash_bits);
+            size_t candidate = table[hash];
+            table[hash] = static_cast<uint32_t>(i + 1);
+            if (candidate == 0 || i - (candidate - 1) > max_offset || read<uint32_t>(src + candidate - 1) != sequence) {
+                i += 1 + (misses++ >> 6);
+                continue;
+            }
 
-    // Add a space to the obj
-    Obj& space() {
-        return add(' ');
-    }
+            // Extend the match 8 bytes at a time
+            size_t match = candidate - 1;
+            size_t length = 4;
+            size_t limit = count - last_literals;
+            while (i + length + 8 <= limit) {
+                uint64_t difference = read<uint64_t>(src + match + length) ^ read<uint64_t>(src + i + length);
+                if (difference) {
+                    length += count_trailing_zeros(difference) / 8; // Assumes a little-endian CPU
+                    break;
+                }
+                length += 8;
+            }
+            if (i + length + 8 > limit) {
+                while (i + length < limit && src[match + length] == src[i + length]) length++;
+            }
 
-    // Add a # character to the current line, this is used for annotations, comments and attributes
-    Obj& hash(int count = 1) {
-        while (count > 0) {
-            hash_count += 1;
-            add("#");
-            count -= 1;
+            out = write_sequence(out, src + anchor, i - anchor, i - match, length);
+            i += length;
+            anchor = i;
+            misses = 0;
         }
-        return *this;
+        out = write_sequence(out, src + anchor, count - anchor, 0, 0);
+        frame.commit(out - first);
     }
 
-    // Add a ! character to the current line, this is used by command annotations
-    Obj& bang() {
-        return add('!');
+    static int count_trailing_zeros(uint64_t value) {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward64(&index, value);
+        return static_cast<int>(index);
+#else
+        return __builtin_ctzll(value);
+#endif
     }
+};
 
-    // Add an @ character to the current line, this is used for attributes
-    Obj& at() {
-        return add('@');
+
+// Converts blocks of small integers to decimal digits with SIMD instructions, this is used by Obj::format_block for
+// the coordinates which are written as integers and for the digits found by the ShortestKernel. Every value in a block
+// is converted at once: the quotients by each power of ten are found by multiplying by its reciprocal in single
+// precision, which is exact up to an off-by-one that is corrected, since the values have at most 7 digits, and the
+// digits are the differences of consecutive quotients. Uses AVX2 if the CPU supports it (detected at runtime with GCC
+// and Clang, and at compile time with MSVC), otherwise SSE2 on x86 and a scalar loop on other architectures
+struct DecimalKernel {
+    static constexpr int block_size = 8;
+    static constexpr int32_t max_value = 9999999;
+
+    // For each of the `block_size` values, which must be in [-max_value, max_value], write the digits of its absolute
+    // value right-aligned in the 8 bytes at `fields + 8 * i` padded with '0's, and its number of digits in `lengths[i]`.
+    // The digits of value i are at `fields + 8 * i + 8 - lengths[i]`
+    static void digits(const int32_t* values, char* fields, int32_t* lengths) {
+        static const auto function = select();
+        function(values, fields, lengths);
     }
 
+    //
+    // Implementation methods
+    //
 
+    using Function = void (*)(const int32_t* values, char* fields, int32_t* lengths);
 
+    static Function select() {
+#if defined(PRIZM_AVX2_DISPATCH)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return digits_avx2;
+#elif defined(__AVX2__)
+        return digits_avx2;
+#endif
+#if defined(PRIZM_SSE2)
+        return digits_sse2;
+#else
+        return digits_scalar;
+#endif
+    }
 
+    static void digits_scalar(const int32_t* values, char* fields, int32_t* lengths) {
+        for (int i = 0; i < block_size; i++) {
+            int32_t value = values[i] < 0 ? -values[i] : values[i];
+            lengths[i] = 1;
+            for (int32_t rest = value / 10; rest; rest /= 10) lengths[i]++;
+            for (int d = 7; d >= 0; d--) {
+                fields[8 * i + d] = static_cast<char>('0' + value % 10);
+                value /= 10;
+            }
+        }
+    }
 
+#if defined(PRIZM_SSE2)
+    static void digits_sse2(const int32_t* values, char* fields, int32_t* lengths) {
+        for (int half = 0; half < 2; half++) {
+            __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + 4 * half));
+            __m128i sign = _mm_srai_epi32(value, 31);
+            value = _mm_sub_epi32(_mm_xor_si128(value, sign), sign);
+            __m128 real = _mm_cvtepi32_ps(value);
 
-    //
-    // Annotations.
-    //
-    // In Prizm the text between the first hash and a newline or second hash is an 'annotation string' and can be shown in the viewport.
+            // The length is 1 plus the number of powers of ten which are at most the value, each compare gives -1
+            __m128i length = _mm_set1_epi32(1);
+            for (int32_t power = 10; power <= 1000000; power *= 10) {
+                length = _mm_sub_epi32(length, _mm_cmpgt_epi32(value, _mm_set1_epi32(power - 1)));
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(lengths + 4 * half), length);
+
+            // The quotients by each power of ten are independent, the remainder is exact in single precision so it
+            // corrects the quotient when the rounded reciprocal made it off by one
+            __m128i quotients[8];
+            quotients[0] = value;
+            quotients[7] = _mm_setzero_si128();
+            float power = 1;
+            for (int d = 1; d < 7; d++) {
+                power *= 10;
+                __m128i quotient = _mm_cvttps_epi32(_mm_mul_ps(real, _mm_set1_ps(1 / power)));
+                __m128 remainder = _mm_sub_ps(real, _mm_mul_ps(_mm_cvtepi32_ps(quotient), _mm_set1_ps(power)));
+                quotient = _mm_add_epi32(quotient, _mm_castps_si128(_mm_cmplt_ps(remainder, _mm_setzero_ps())));
+                quotient = _mm_sub_epi32(quotient, _mm_castps_si128(_mm_cmpge_ps(remainder, _mm_set1_ps(power))));
+                quotients[d] = quotient;
+            }
+            __m128i digits[7];
+            for (int d = 0; d < 7; d++) {
+                __m128i tens = _mm_add_epi32(_mm_slli_epi32(quotients[d + 1], 3), _mm_slli_epi32(quotients[d + 1], 1));
+                digits[d] = _mm_sub_epi32(quotients[d], tens);
+            }
 
-    // Start an annotation: If there is no hash character on the current line add one, otherwise do nothing
-    Obj& annotation() {
-        if (hash_count == 0) {
-            // Add a space here to help other obj viewers which might fail to parse numbers not delimited by whitespace
-            space().hash();
+            // The 4 most significant digits go in `high` and the 4 least significant in `low`, first digit lowest
+            __m128i high = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(digits[6], 8), _mm_slli_epi32(digits[5], 16)),
+                _mm_slli_epi32(digits[4], 24));
+            __m128i low = _mm_or_si128(_mm_or_si128(digits[3], _mm_slli_epi32(digits[2], 8)),
+                _mm_or_si128(_mm_slli_epi32(digits[1], 16), _mm_slli_epi32(digits[0], 24)));
+            __m128i zeros = _mm_set1_epi8('0');
+            high = _mm_add_epi8(high, zeros);
+            low = _mm_add_epi8(low, zeros);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(fields + 32 * half), _mm_unpacklo_epi32(high, low));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(fields + 32 * half + 16), _mm_unpackhi_epi32(high, low));
         }
-        return *this;
     }
+#endif
 
-    // Add an annotation containing the given data to the obj. See annotation()
-    template <typename T> Obj& annotation(const T& data) {
-        return annotation().insert(data);
-    }
+#if defined(PRIZM_AVX2_DISPATCH) || defined(__AVX2__)
+#if defined(PRIZM_AVX2_DISPATCH)
+    __attribute__((target("avx2")))
+#endif
+    static void digits_avx2(const int32_t* values, char* fields, int32_t* lengths) {
+        __m256i value = _mm256_abs_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(values)));
+        __m256 real = _mm256_cvtepi32_ps(value);
 
+        __m256i length = _mm256_set1_epi32(1);
+        for (int32_t power = 10; power <= 1000000; power *= 10) {
+            length = _mm256_sub_epi32(length, _mm256_cmpgt_epi32(value, _mm256_set1_epi32(power - 1)));
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(lengths), length);
+
+        __m256i quotients[8];
+        quotients[0] = value;
+        quotients[7] = _mm256_setzero_si256();
+        float power = 1;
+        for (int d = 1; d < 7; d++) {
+            power *= 10;
+            __m256i quotient = _mm256_cvttps_epi32(_mm256_mul_ps(real, _mm256_set1_ps(1 / power)));
+            __m256 remainder = _mm256_sub_ps(real, _mm256_mul_ps(_mm256_cvtepi32_ps(quotient), _mm256_set1_ps(power)));
+            quotient = _mm256_add_epi32(quotient, _mm256_castps_si256(_mm256_cmp_ps(remainder, _mm256_setzero_ps(), _CMP_LT_OQ)));
+            quotient = _mm256_sub_epi32(quotient, _mm256_castps_si256(_mm256_cmp_ps(remainder, _mm256_set1_ps(power), _CMP_GE_OQ)));
+            quotients[d] = quotient;
+        }
+        __m256i digits[7];
+        for (int d = 0; d < 7; d++) {
+            digits[d] = _mm256_sub_epi32(quotients[d], _mm256_mullo_epi32(quotients[d + 1], _mm256_set1_epi32(10)));
+        }
 
+        __m256i high = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(digits[6], 8), _mm256_slli_epi32(digits[5], 16)),
+            _mm256_slli_epi32(digits[4], 24));
+        __m256i low = _mm256_or_si256(_mm256_or_si256(digits[3], _mm256_slli_epi32(digits[2], 8)),
+            _mm256_or_si256(_mm256_slli_epi32(digits[1], 16), _mm256_slli_epi32(digits[0], 24)));
+        __m256i zeros = _mm256_set1_epi8('0');
+        high = _mm256_add_epi8(high, zeros);
+        low = _mm256_add_epi8(low, zeros);
 
+        // The unpacks work within 128-bit lanes, giving values 0 1 4 5 and 2 3 6 7
+        __m256i a = _mm256_unpacklo_epi32(high, low);
+        __m256i b = _mm256_unpackhi_epi32(high, low);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(fields), _mm256_permute2x128_si256(a, b, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(fields + 32), _mm256_permute2x128_si256(a, b, 0x31));
+    }
+#endif
+};
 
+// Finds the shortest decimal representations of blocks of floats or doubles with SIMD instructions, this is used by
+// Obj::format_block for the coordinates which aren't integers. The representation is the one std::to_chars writes: the
+// fewest significant digits which round back to the value, and the closest to the value if there are several. Each
+// value is scaled by a power of ten to a fixed number of digits in double-double arithmetic, giving the range of
+// integers which round to the value at that scale. The shortest digits are then the multiple of the largest power of
+// ten which has a multiple in the range, this power is found for every value at once by comparing the quotients of
+// the range bounds by each power. Uses AVX2 and FMA if the CPU supports them (detected at runtime with GCC and Clang,
+// and at compile time with MSVC), otherwise std::to_chars should be used, which is faster than this without SIMD
+struct ShortestKernel {
+    static constexpr int block_size = 8;
+    static constexpr int32_t fallback = std::numeric_limits<int32_t>::min();
+
+    // For each of the `block_size` values write its shortest representation as ±significands[i] * 10^exponents[i],
+    // the significand is an integer without trailing zeros with at most 9 digits for floats and 15 for doubles. The
+    // exponent is `fallback` for the values which std::to_chars must convert: zeros, subnormals, infinities and NaNs,
+    // values outside about [1e-13, 1e31] for floats and [1e-8, 1e36] for doubles, doubles which need more than 15
+    // digits and the rare values for which a bound of the range is too close to an integer to be decided. Returns
+    // false without writing anything if the CPU isn't supported
+    template <typename T> static bool shortest(const T* values, double* significands, int32_t* exponents) {
+        static const auto function = select<T>();
+        if (!function) return false;
+        function(values, significands, exponents);
+        return true;
+    }
 
     //
-    // Comments.
-    //
-    // In Prizm any text that follows the second # on a line is ignored
+    // Implementation methods
     //
 
-    // Ensure there are two hash characters on the current line
-    Obj& comment() {
-        while (hash_count < 2) {
-            hash();
+    template <typename T> using Function = void (*)(const T* values, double* significands, int32_t* exponents);
+
+    template <typename T> static Function<T> select() {
+#if defined(PRIZM_AVX2_DISPATCH)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return shortest_avx2<T>;
+#elif defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER))
+        return shortest_avx2<T>;
+#endif
+        return nullptr;
+    }
+
+    // Values are scaled to this many digits. At this scale floats always have a multiple of 100 in their range, so
+    // the search starts at that power, doubles may have none and fall back
+    template <typename T> static constexpr int scaled_digits() { return std::is_same<T, float>::value ? 10 : 15; }
+    template <typename T> static constexpr int first_power() { return std::is_same<T, float>::value ? 2 : 0; }
+
+    // 10^i for i in [-22, 22], the nearest double and the rounding error
+    static constexpr double powers[45][2] = {
+        {1e-22, -0x1.a7566d9cba769p-128}, {1e-21, 0x1.f769fb7e0b75ep-124},
+        {1e-20, 0x1.75447a5d8e536p-121}, {1e-19, 0x1.a52b31e9e3d07p-119},
+        {1e-18, -0x1.7c628066e8ceep-114}, {1e-17, -0x1.db7b2080a3029p-111},
+        {1e-16, 0x1.5b4c2ebe68799p-109}, {1e-15, -0x1.937831647f5ap-104},
+        {1e-14, 0x1.ea70909833de7p-107}, {1e-13, -0x1.ecd79a5a0df95p-99},
+        {1e-12, 0x1.97f27f0f6e886p-96}, {1e-11, 0x1.7f7bc7b4d28aap-91},
+        {1e-10, -0x1.20a5465df8d2cp-88}, {1e-9, -0x1.34674bfabb83bp-84},
+        {1e-8, -0x1.03023df2d4c94p-82}, {1e-7, 0x1.5e1e99483b023p-78},
+        {1e-6, 0x1.b5a63f9a49c2cp-75}, {1e-5, -0x1.ee78183f91e64p-71},
+        {1e-4, -0x1.6a161e4f765fep-68}, {1e-3, -0x1.89374bc6a7efap-66},
+        {1e-2, -0x1.eb851eb851eb8p-63}, {1e-1, -0x1.999999999999ap-58},
+        {1e0, 0}, {1e1, 0}, {1e2, 0}, {1e3, 0}, {1e4, 0}, {1e5, 0}, {1e6, 0}, {1e7, 0},
+        {1e8, 0}, {1e9, 0}, {1e10, 0}, {1e11, 0}, {1e12, 0}, {1e13, 0}, {1e14, 0}, {1e15, 0},
+        {1e16, 0}, {1e17, 0}, {1e18, 0}, {1e19, 0}, {1e20, 0}, {1e21, 0}, {1e22, 0}
+    };
+
+#if defined(PRIZM_AVX2_DISPATCH) || (defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER)))
+    template <typename T>
+#if defined(PRIZM_AVX2_DISPATCH)
+    __attribute__((target("avx2,fma")))
+#endif
+    static void shortest_avx2(const T* values, double* significands, int32_t* exponents) {
+        constexpr int n = scaled_digits<T>();
+        const __m256d one = _mm256_set1_pd(1), half = _mm256_set1_pd(0.5), zero = _mm256_setzero_pd();
+        const __m256d sign = _mm256_set1_pd(-0.0), all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+        const __m256d tolerance = _mm256_set1_pd(0x1p-40), one_minus_tolerance = _mm256_set1_pd(1 - 0x1p-40);
+
+        for (int g = 0; g < block_size; g += 4) {
+            __m256d value;
+            if constexpr (std::is_same<T, float>::value) value = _mm256_cvtps_pd(_mm_loadu_ps(values + g));
+            else value = _mm256_loadu_pd(values + g);
+            value = _mm256_andnot_pd(sign, value);
+
+            // x is log10(value) rounded down, or 1 more, and the value is scaled by 10^s to have n digits
+            __m256i bits = _mm256_castpd_si256(value);
+            __m256i biased = _mm256_srli_epi64(bits, 52);
+            __m256d exponent = _mm256_sub_pd(
+                _mm256_castsi256_pd(_mm256_or_si256(biased, _mm256_set1_epi64x(0x4330000000000000))), // 2^52 + biased
+                _mm256_set1_pd(0x1p52 + 1022));
+            __m256d x = _mm256_floor_pd(_mm256_mul_pd(exponent, _mm256_set1_pd(0.30102999566398120)));
+            __m256d s = _mm256_sub_pd(_mm256_set1_pd(n - 1), x);
+            __m256d valid = _mm256_and_pd(_mm256_cmp_pd(s, _mm256_set1_pd(-22), _CMP_GE_OQ),
+                _mm256_cmp_pd(s, _mm256_set1_pd(22), _CMP_LE_OQ));
+            __m128i index = _mm256_cvtpd_epi32(_mm256_add_pd(_mm256_and_pd(valid, s), _mm256_set1_pd(22)));
+            index = _mm_slli_epi32(index, 1);
+            __m256d power = _mm256_mask_i32gather_pd(zero, &powers[0][0], index, all, 8);
+            __m256d power_low = _mm256_mask_i32gather_pd(zero, &powers[0][1], index, all, 8);
+
+            // Half the gaps to the next values, the one below is smaller for powers of two
+            __m256d above = _mm256_castsi256_pd(_mm256_slli_epi64(
+                _mm256_sub_epi64(biased, _mm256_set1_epi64x(std::numeric_limits<T>::digits)), 52));
+            __m256d power_of_two = _mm256_castsi256_pd(
+                _mm256_cmpeq_epi64(_mm256_slli_epi64(bits, 12), _mm256_setzero_si256()));
+            __m256d below = _mm256_blendv_pd(above, _mm256_mul_pd(above, half), power_of_two);
+
+            // The scaled value is y + y_low, and the bounds of its rounding range upper + upper_low and lower +
+            // lower_low. The integers in the range are [low, high], unless a bound is so close to an integer that
+            // whether it is included can't be decided, then the value falls back
+            __m256d y = _mm256_mul_pd(value, power);
+            __m256d y_low = _mm256_fmadd_pd(value, power_low, _mm256_fmsub_pd(value, power, y));
+            __m256d above_scaled = _mm256_mul_pd(above, power), below_scaled = _mm256_mul_pd(below, power);
+            __m256d upper = _mm256_add_pd(y, above_scaled);
+            __m256d upper_low = _mm256_add_pd(_mm256_sub_pd(above_scaled, _mm256_sub_pd(upper, y)),
+                _mm256_fmadd_pd(above, power_low, y_low));
+            __m256d lower = _mm256_sub_pd(y, below_scaled);
+            __m256d lower_low = _mm256_add_pd(_mm256_sub_pd(_mm256_sub_pd(y, lower), below_scaled),
+                _mm256_fnmadd_pd(below, power_low, y_low));
+            __m256d high = _mm256_floor_pd(upper), high_fraction = _mm256_add_pd(_mm256_sub_pd(upper, high), upper_low);
+            __m256d low = _mm256_floor_pd(lower), low_fraction = _mm256_add_pd(_mm256_sub_pd(lower, low), lower_low);
+            __m256d carry = _mm256_sub_pd(_mm256_and_pd(_mm256_cmp_pd(high_fraction, one, _CMP_GE_OQ), one),
+                _mm256_and_pd(_mm256_cmp_pd(high_fraction, zero, _CMP_LT_OQ), one));
+            high = _mm256_add_pd(high, carry);
+            high_fraction = _mm256_sub_pd(high_fraction, carry);
+            carry = _mm256_sub_pd(_mm256_and_pd(_mm256_cmp_pd(low_fraction, one, _CMP_GE_OQ), one),
+                _mm256_and_pd(_mm256_cmp_pd(low_fraction, zero, _CMP_LT_OQ), one));
+            low = _mm256_add_pd(low, _mm256_add_pd(carry, one));
+            low_fraction = _mm256_sub_pd(low_fraction, carry);
+            valid = _mm256_and_pd(valid, _mm256_and_pd(
+                _mm256_and_pd(_mm256_cmp_pd(high_fraction, tolerance, _CMP_GT_OQ),
+                    _mm256_cmp_pd(high_fraction, one_minus_tolerance, _CMP_LT_OQ)),
+                _mm256_and_pd(_mm256_cmp_pd(low_fraction, tolerance, _CMP_GT_OQ),
+                    _mm256_cmp_pd(low_fraction, one_minus_tolerance, _CMP_LT_OQ))));
+
+            // 10^k has a multiple in [low, high] if floor(high / 10^k) > floor((low - 1) / 10^k). Adding 0.5 to the
+            // bounds keeps the quotients away from integers, so the rounded reciprocal gives the same floors. If 10^k
+            // has no multiple in the range neither have the larger powers, so the loop ends when no lane has one
+            __m256d high_half = _mm256_add_pd(high, half), low_half = _mm256_sub_pd(low, half);
+            // 10^j is the largest power with a multiple in the range, q is floor(high / 10^j)
+            constexpr int first = first_power<T>() - 1;
+            __m256d j = _mm256_set1_pd(first);
+            __m256d power_j = _mm256_set1_pd(powers[22 + first][0]), reciprocal = _mm256_set1_pd(powers[22 - first][0]);
+            __m256d q = _mm256_floor_pd(_mm256_mul_pd(high_half, reciprocal));
+            for (int k = first + 1; k <= n; k++) {
+                __m256d reciprocal_k = _mm256_set1_pd(powers[22 - k][0]);
+                __m256d q_k = _mm256_floor_pd(_mm256_mul_pd(high_half, reciprocal_k));
+                __m256d has_multiple = _mm256_cmp_pd(q_k, _mm256_floor_pd(_mm256_mul_pd(low_half, reciprocal_k)), _CMP_GT_OQ);
+                if (_mm256_testz_pd(has_multiple, has_multiple)) break;
+                j = _mm256_add_pd(j, _mm256_and_pd(has_multiple, one));
+                q = _mm256_blendv_pd(q, q_k, has_multiple);
+                power_j = _mm256_blendv_pd(power_j, _mm256_set1_pd(powers[22 + k][0]), has_multiple);
+                reciprocal = _mm256_blendv_pd(reciprocal, reciprocal_k, has_multiple);
+            }
+            valid = _mm256_and_pd(valid, _mm256_cmp_pd(j, zero, _CMP_GE_OQ));
+
+            // The significand is the multiple of 10^j in [low, high] nearest to the value, ties fall back
+            __m256d offset = _mm256_mul_pd(_mm256_add_pd(_mm256_fnmadd_pd(q, power_j, y), y_low), reciprocal);
+            __m256d nearest = _mm256_floor_pd(_mm256_add_pd(offset, half));
+            __m256d distance = _mm256_andnot_pd(sign, _mm256_sub_pd(offset, nearest));
+            valid = _mm256_and_pd(valid, _mm256_cmp_pd(
+                _mm256_andnot_pd(sign, _mm256_sub_pd(distance, half)), tolerance, _CMP_GE_OQ));
+            __m256d significand = _mm256_add_pd(q, _mm256_min_pd(nearest, zero));
+            significand = _mm256_add_pd(significand,
+                _mm256_and_pd(_mm256_cmp_pd(_mm256_mul_pd(significand, power_j), low, _CMP_LT_OQ), one));
+
+            __m256d exponent10 = _mm256_add_pd(_mm256_sub_pd(x, _mm256_set1_pd(n - 1)), j);
+            _mm256_storeu_pd(significands + g, _mm256_and_pd(valid, significand));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(exponents + g), _mm256_cvtpd_epi32(_mm256_and_pd(valid, exponent10)));
+            int mask = _mm256_movemask_pd(valid);
+            for (int i = 0; i < 4; i++) {
+                if (!(mask & (1 << i))) exponents[g + i] = fallback;
+            }
         }
-        return *this;
     }
+#endif
 
-    // Ensure there are two # characters on the current line then insert the comment content
-    template <typename T> Obj& comment(T content) {
-        return comment().insert(content);
+    // Write ±digits * 10^exponent at `out` like std::to_chars does, in fixed notation unless exponent notation is
+    // shorter, and return the end of the written text. Returns nullptr if fixed notation needs zeros after the digits,
+    // std::to_chars writes the exact digits of such (integral) values instead. The digits are copied 16 bytes at a time,
+    // so up to 16 bytes after them are read and up to 48 bytes at `out` are written
+    static char* write(char* out, bool negative, const char* digits, int length, int exponent) {
+        *out = '-';
+        out += negative;
+        int x = exponent + length - 1; // The exponent of the first digit
+        int fixed_length = x >= length - 1 ? x + 1 : x >= 0 ? length + 1 : length + 1 - x;
+        int exponent_length = length + (length > 1) + (x >= 100 || x <= -100 ? 5 : 4);
+        if (fixed_length <= exponent_length) {
+            if (x >= length - 1) {
+                if (exponent > 0) return nullptr;
+                std::memcpy(out, digits, 16);
+            } else if (x >= 0) {
+                std::memcpy(out, digits, 16);
+                std::memcpy(out + x + 2, digits + x + 1, 16);
+                out[x + 1] = '.';
+            } else {
+                std::memcpy(out, "0.000000", 8); // Exponent notation is shorter below 1e-4
+                std::memcpy(out + 1 - x, digits, 16);
+            }
+            return out + fixed_length;
+        }
+        out[0] = digits[0];
+        out[1] = '.';
+        std::memcpy(out + 2, digits + 1, 16);
+        out += length + (length > 1);
+        out[0] = 'e';
+        out[1] = x < 0 ? '-' : '+';
+        if (x < 0) x = -x;
+        if (x >= 100) {
+            out[2] = static_cast<char>('0' + x / 100);
+            x %= 100;
+            out++;
+        }
+        out[2] = static_cast<char>('0' + x / 10);
+        out[3] = static_cast<char>('0' + x % 10);
+        return out + 4;
     }
+};
 
+// A read-only view of `count` N-dimensional vectors stored in user memory. The d-th coordinate of the i-th vector is
+// read from `coords[d]` offset by `i * stride` bytes, this supports packed (xyzxyz...) buffers, arrays of structs
+// with padding or other members and separate per-coordinate arrays, without copying or converting to Prizm types.
+// Use the strided() functions below to make these
+template <typename T, int N>
+struct Strided {
+    const T* coords[N] = {};
+    size_t stride = 0;
+    int count = 0;
 
-
-
-    //
-    // Vectors
-    //
-
-    // Add 2D vector
-    // Note: writes " x y" to the obj
-    template <typename T> Obj& vector2(T x, T y) {
-        return vector2(Vec2<T>(x, y));
+    T at(int i, int d) const {
+        return *reinterpret_cast<const T*>(reinterpret_cast<const char*>(coords[d]) + i * stride);
     }
 
-    // Add 2D vector
-    // Note: writes " v.x v.y" to the obj
-    template <typename T> Obj& vector2(Vec2<T> v) {
-        return insert(v);
+    explicit operator bool() const {
+        return count > 0;
     }
 
-    // Add 3D vector
-    // Note: writes " x y z" to the obj
-    template <typename T> Obj& vector3(T x, T y, T z) {
-        return vector3(Vec3<T>(x, y, z));
+    // Returns a view of the vectors with indices in [begin, end)
+    Strided slice(int begin, int end) const {
+        Strided result = *this;
+        for (int d = 0; d < N; d++) {
+            result.coords[d] = reinterpret_cast<const T*>(reinterpret_cast<const char*>(coords[d]) + begin * stride);
+        }
+        result.count = end - begin;
+        return result;
     }
 
-    // Add 3D vector
-    // Note: writes " v.x v.y v.z" to the obj
-    template <typename T> Obj& vector3(Vec3<T> v) {
-        return insert(v);
+    // Copies the vectors with the given indices to `storage` and returns a view of the copies
+    Strided gather(const std::vector<int>& indices, std::vector<T>& storage) const {
+        if (count == 0) return {};
+        storage.resize(N * indices.size());
+        for (size_t j = 0; j < indices.size(); j++) {
+            for (int d = 0; d < N; d++) storage[N * j + d] = at(indices[j], d);
+        }
+        Strided result;
+        for (int d = 0; d < N; d++) result.coords[d] = storage.data() + d;
+        result.stride = N * sizeof(T);
+        result.count = static_cast<int>(indices.size());
+        return result;
     }
+};
 
-    // Add 4D vector
-    // Note: writes " x y z w" to the obj
-    template <typename T> Obj& vector4(T x, T y, T z, T w) {
-        return vector4(Vec4<T>(x, y, z, w));
+// Make a view of `count` vectors with N coordinates stored contiguously, starting at `first`. `stride` is the number
+// of bytes between consecutive vectors, e.g., `strided<3>(&vertices[0].position.x, n, sizeof(vertices[0]))`
+template <int N, typename T> Strided<T, N> strided(const T* first, int count, size_t stride = N * sizeof(T)) {
+    Strided<T, N> result;
+    if (first) {
+        for (int d = 0; d < N; d++) result.coords[d] = first + d;
+        result.stride = stride;
+        result.count = count;
     }
+    return result;
+}
 
-    // Add 4D vector
-    // Note: writes " v.x v.y v.z v.w" to the obj
-    template <typename T> Obj& vector4(Vec4<T> v) {
-        return insert(v);
-    }
+// Make a view of `count` 2D vectors stored in separate x and y arrays
+template <typename T> Strided<T, 2> strided(const T* xs, const T* ys, int count) {
+    Strided<T, 2> result;
+    result.coords[0] = xs;
+    result.coords[1] = ys;
+    result.stride = sizeof(T);
+    result.count = count;
+    return result;
+}
 
+// Make a view of `count` 3D vectors stored in separate x, y and z arrays
+template <typename T> Strided<T, 3> strided(const T* xs, const T* ys, const T* zs, int count) {
+    Strided<T, 3> result;
+    result.coords[0] = xs;
+    result.coords[1] = ys;
+    result.coords[2] = zs;
+    result.stride = sizeof(T);
+    result.count = count;
+    return result;
+}
 
 
+// An example using the API and an explanation of the rationale behind it.
+// Returns boolean to indicate if the documentation tests pass
+bool documentation(bool write_files = false);
 
-    //
-    // Vertices/Positions.
-    //
-    // :ObjIndexing Vertex indexing is 1-based and can be negative:
-    // * If index >  0 the index refers to the index-th added vertex
-    // * If index <  0 the index refers to index-th preceeding vertex relative to line containing the element with the reference
-    // * if index == 0 the index is invalid, this is a (silent!) error
-    // Vertices should be referenced by elements that are written later in the obj file
-    //
+// A unit sphere centered at the origin, tessellated into an indexed triangle mesh
+struct SphereMesh {
+    std::vector<float> points; // 3 coordinates per vertex
+    std::vector<uint32_t> triangles; // 3 0-based vertex indices per triangle
+};
 
-    // Add a 2D position
-    // Note: writes "\nv a.x a.y" to the obj
-    template <typename T> Obj& vertex2(Vec2<T> a) {
-        return v().vector2(a);
-    }
+// Returns the unit sphere with the given resolution, which is clamped to at least 3 slices and 3 stacks. Each resolution
+// is tessellated once and cached, so Obj::sphere3 and Obj::spheres3 only scale and translate the cached vertices. The
+// reference stays valid until the program exits, and this function is thread-safe
+const SphereMesh& unit_sphere_mesh(int slices, int stacks);
 
-    // Add a 3D position
-    // Note: writes "\nv a.x a.y a.z" to the obj
-    template <typename T> Obj& vertex3(Vec3<T> a) {
-        return v().vector3(a);
-    }
+// Convert OBJ text to the binary .prizmb format, Obj::write calls this for ".prizmb" filenames. A .prizmb file stores
+// the mesh the viewer builds from the OBJ text (positions, colors, point/segment/triangle elements, their normals,
+// annotations, prototypes and instances) as arrays the viewer copies directly, so large files load much faster since
+// there is no text to tokenize or floats to parse. The layout, where all numbers are little-endian, is:
+//
+//   Header: "PRIZMB", u8 version = 1, u8 0, u32 section count, u32 0
+//   Sections: char tag[4], u32 item size, u64 item count, then the items padded with zeros to a multiple of 8 bytes,
+//   so every section is 8-byte aligned if the file is mapped into memory:
+//     "POSN" Vertex positions, 3 floats per vertex
+//     "COLR" Vertex colors, 3 f32 per vertex in [0,1], NaN for vertices without a color. Omitted if no vertex has one
+//     "PNTS" Point elements, u32 vertex index, 0xFFFFFFFF if the OBJ referenced a missing vertex
+//     "SEGS" Segment elements, 2 u32 vertex indices. Polylines are split into segments
+//     "TRIS" Triangle elements, 3 u32 vertex indices. Polygons are split into triangle fans
+//     "PNRM", "SNRM", "TNRM" Normals of each point/segment/triangle, 3 floats per element vertex, zero for elements
+//          without normals. Omitted if no element of the kind references normals
+//     "ANNO" Annotations, item size 0. Each item is u32 kind, u32 id, u32 byte count, the text and zero padding to a
+//          multiple of 4 bytes. Kinds are 0 vertex, 1 point, 2 segment, 3 triangle (the id is the element index),
+//          4 block comment (the id is the order in the file) and 5 command. Items are sorted by kind then id
+//     "PROT" Prototype shapes, see Obj::prototype_begin, item size 0, in the order they are declared. Each item is u32
+//          name byte count, u32 vertex count v, u32 point count p, u32 segment count s, u32 triangle count t, u32 1 if
+//          the triangles have normals and 0 otherwise, the name and zero padding to a multiple of 4 bytes, then 3v f64
+//          positions, p + 2s + 3t u32 vertex indices into the shape's positions (points, then segments, then triangles)
+//          and, if the triangles have normals, 9t f64 normal components. The colors of the shape's vertices are not
+//          stored since instances have their own color. Omitted if there are no prototypes
+//     "INST" Instances, see Obj::instance, item size 112. Each item is the 12 f64 rows of the 3x4 transform, the u32
+//          index of the item in PROT and 3 f32 color components, NaN if the instance has no color. Omitted if there
+//          are no instances
+//
+// Float sections use f32 if every value is exactly representable as a float, otherwise f64, so e.g., the item size of
+// POSN is 12 or 24. Texture coordinates, groups and materials are ignored, as they are by the viewer
+std::string obj_to_prizmb(std::string_view obj);
+
+// Convert a .prizmb file back to OBJ text which the viewer loads identically, and which converts back to the same
+// .prizmb file. Returns an empty string if `prizmb` is not a valid .prizmb file
+std::string prizmb_to_obj(std::string_view prizmb);
+
+// Returns the OBJ text of each frame of a .prizmf file written by Prizm::FrameWriter, or an empty vector if the file
+// can't be read. If the frame index is missing, e.g., because the writer crashed, the complete frames are returned
+std::vector<std::string> read_frames(const std::string& filename);
+
+// The mesh the viewer builds from OBJ text, this is what a .prizmb file stores
+struct PrizmbMesh {
+    enum AnnotationKind : uint32_t { VERTEX, POINT, SEGMENT, TRIANGLE, BLOCK, COMMAND };
+    struct Annotation {
+        uint32_t kind;
+        uint32_t id;
+        std::string text;
+    };
 
-    // Add a 2D position with color
-    // Note: writes "\nv a.x a.y c.r c.g c.b" to the obj
-    template <typename T> Obj& vertex2(Vec2<T> a, Color c) {
-        return v().vector2(a).vector3(c);
+    std::vector<double> positions; // x, y, z per vertex
+    std::vector<float> colors; // r, g, b per vertex, NaN if the vertex has no color
+    bool has_colors = false;
+    std::vector<uint32_t> points, segments, triangles;
+    std::vector<double> point_normals, segment_normals, triangle_normals; // x, y, z per element vertex
+    std::vector<Annotation> annotations;
+
+    // A shape declared by the prototype directives, the viewer removes its vertices and elements from the mesh
+    struct Prototype {
+        std::string name;
+        std::vector<double> positions; // x, y, z per shape vertex
+        std::vector<uint32_t> points, segments, triangles; // Indices into the shape's positions
+        std::vector<double> triangle_normals; // x, y, z per triangle vertex, or empty
+    };
+    struct Instance {
+        double rows[12]; // The rows of the 3x4 affine transform
+        uint32_t prototype; // Index into `prototypes`
+        float color[3]; // NaN if the instance has no color
+    };
+    std::vector<Prototype> prototypes;
+    std::vector<Instance> instances;
+};
+
+// Returns the mesh the viewer builds from the OBJ text `obj`
+PrizmbMesh prizmb_mesh_from_obj(std::string_view obj);
+
+// Returns a .prizmd delta which changes the mesh the viewer builds from the OBJ text `previous` into the mesh it builds
+// from `obj`, see Prizm::DeltaWriter. The delta is text with one entry per line:
+//   "base <filename> <sequence> <vertex count> <point count> <segment count> <triangle count>" The file the delta
+//        applies to, relative to the delta, the number of the delta (the first one is 1) and the counts of `previous`.
+//        The viewer only applies a delta to an item with these counts, after the delta numbered `sequence - 1`
+//   "vertex_count <count>" The new number of vertices, if it changed
+//   "v <index> <x y z> [<r g b>]" A vertex which changed or was added, using a 1-based index. Without a color the
+//        vertex gets the default color
+//   "points <count>", "segments <count>", "triangles <count>" The number of elements of the kind which are kept, if
+//        the elements of that kind changed. The elements after this are removed and the following "p", "l" or "f"
+//        lines (using 1-based vertex indices) are appended. Polylines and polygons are split as in obj_to_prizmb
+std::string obj_delta(std::string_view previous, std::string_view obj, const std::string& base_filename, uint64_t sequence);
+
+// As above, for meshes already built from the OBJ text, e.g., to avoid parsing each frame twice
+std::string obj_delta(const PrizmbMesh& previous, const PrizmbMesh& mesh, const std::string& base_filename, uint64_t sequence);
+
+// Exact vertex data used to find welded vertices, see Obj::set_welding
+struct WeldKey {
+    uint64_t bits[4] = {}; // The bits of the coordinates as doubles, then the dimension and color
+    bool operator==(const WeldKey& other) const {
+        return std::memcmp(bits, other.bits, sizeof(bits)) == 0;
     }
+};
 
-    // Add a 3D position with color
-    // Note: writes "\nv a.x a.y a.z" to the obj
-    template <typename T> Obj& vertex3(Vec3<T> a, Color c) {
-        return v().vector3(a).vector3(c);
+struct WeldKeyHash {
+    size_t operator()(const WeldKey& key) const {
+        uint64_t hash = 14695981039346656037ull;
+        for (uint64_t bits : key.bits) {
+            hash = (hash ^ bits) * 1099511628211ull;
+            hash ^= hash >> 32;
+        }
+        return static_cast<size_t>(hash);
     }
+};
 
+// Axis-aligned bounds of the vertices of an element, 2D vertices have z = 0
+struct Bounds {
+    double lo[3] = { std::numeric_limits<double>::infinity(),  std::numeric_limits<double>::infinity(),  std::numeric_limits<double>::infinity()};
+    double hi[3] = {-std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity()};
 
+    void add(double x, double y, double z) {
+        double p[3] = {x, y, z};
+        for (int d = 0; d < 3; d++) {
+            lo[d] = std::min(lo[d], p[d]);
+            hi[d] = std::max(hi[d], p[d]);
+        }
+    }
+    template <typename T> void add(Vec2<T> v) { add(v.x, v.y, 0); }
+    template <typename T> void add(Vec3<T> v) { add(v.x, v.y, v.z); }
+    template <typename T, int N> void add(const Strided<T, N>& view, int i) {
+        if constexpr (N == 2) add(view.at(i, 0), view.at(i, 1), 0);
+        else add(view.at(i, 0), view.at(i, 1), view.at(i, 2));
+    }
+    void add(const Bounds& other) {
+        for (int d = 0; d < 3; d++) {
+            lo[d] = std::min(lo[d], other.lo[d]);
+            hi[d] = std::max(hi[d], other.hi[d]);
+        }
+    }
+};
 
+// Grid used to write vertex positions as integers, see Obj::set_quantization
+struct Quantization {
+    bool enabled = false;
+    double min[3] = {}; // Grid origin
+    double max[3] = {};
+    double step = 1; // Grid spacing
+    double inverse_step = 1;
 
-    //
-    // Normals, Textures, Tangents. Indexing is 1-based, see :ObjIndexing
-    //
+    // Grid coordinates larger than this are not exactly representable as integers, so they are written as floats
+    static constexpr double max_integer = 9007199254740992.0; // 2^53
 
-    // Add a 3D normal
-    // Note: writes "\nvn n.x n.y n.z" to the obj
-    template <typename T> Obj& normal3(Vec3<T> n) {
-        return vn().vector3(n);
+    // Returns the grid coordinate of `value` along axis d, see is_integer
+    double quantize(double value, int d) const {
+        return std::round((value - min[d]) * inverse_step);
     }
 
-    // Add a UV coordinate (2D texture vertex)
-    // Note: writes "\nvt t.x t.y" to the obj
-    template <typename T> Obj& uv2(Vec2<T> t) {
-        return vt().vector2(t);
+    // Returns true if grid coordinate `q` is written as an integer. Otherwise, i.e., for the non-finite coordinates of
+    // non-finite values and coordinates beyond 2^53 of values far outside the grid, it's written as a float, which the
+    // viewer dequantizes the same way
+    static bool is_integer(double q) {
+        return std::isfinite(q) && std::abs(q) <= max_integer;
     }
+};
 
-    // Add a 3D tangent (3D texture vertex)
-    // Note: writes "\nvt t.x t.y t.z" to the obj
-    // @TODO Rename to uvw or uv3?
-    template <typename T> Obj& tangent3(Vec3<T> t) {
-        return vt().vector3(t);
+// Region of interest used to drop elements at write time, see Obj::set_region_aabb and Obj::set_region_sphere
+struct Region {
+    enum Kind { NONE, AABB, SPHERE };
+    Kind kind = NONE;
+    double min[3] = {}; // Used by AABB regions
+    double max[3] = {};
+    double center[3] = {}; // Used by SPHERE regions
+    double radius = 0;
+
+    // Returns false if the given bounds are entirely outside the region. Bounds with NaN coordinates overlap
+    bool overlaps(const Bounds& bounds) const {
+        if (kind == AABB) {
+            for (int d = 0; d < 3; d++) {
+                if (bounds.hi[d] < min[d] || bounds.lo[d] > max[d]) return false;
+            }
+            return true;
+        }
+        if (kind == SPHERE) {
+            // Squared distance from the center to the closest point in the bounds
+            double distance2 = 0;
+            for (int d = 0; d < 3; d++) {
+                double e = center[d] < bounds.lo[d] ? bounds.lo[d] - center[d]
+                         : center[d] > bounds.hi[d] ? center[d] - bounds.hi[d] : 0;
+                distance2 += e * e;
+            }
+            return !(distance2 > radius * radius);
+        }
+        return true;
     }
+};
 
+// Files written by an Obj in sharded streaming mode, see the Obj(filename, flush_size, shard_size) constructor
+struct Shards {
+    size_t max_size = 0; // Zero if not sharding, otherwise the text size at which a new shard is started
+    std::string stem; // The i-th shard is written to stem.i followed by suffix, e.g., "dump.0003.obj"
+    std::string suffix;
+    int index = 0; // Index of the current shard
+    size_t begin = 0; // Obj::flushed_count when the current shard was started
+    unsigned v_begin = 0; // Obj::v_count when the current shard was started
+    std::string manifest; // Lines describing the finished shards, the current shard is listed after them
 
-
-    //
-    // Point Elements.  Indices are 1-based, see :ObjIndexing
-    //
-
-    // Add a point element referencing the i-th vertex position
-    Obj& point(int i = -1) {
-        return p().insert(v_index(i));
+    // Splits e.g., "dump.obj" or "dump.obj.lz4" into the stem "dump" and the suffix
+    void set_filename(const std::string& filename) {
+        size_t dot = filename.rfind(".obj");
+        bool has_suffix = dot != std::string::npos && dot > filename.find_last_of("/\\") + 1;
+        stem = has_suffix ? filename.substr(0, dot) : filename;
+        suffix = has_suffix ? filename.substr(dot) : std::string();
     }
 
-    // Add a oriented point element referencing the previous vertex position and normal (default).
-    // The user can provide explicit indicies to reference vertex vi and normal ni
-    Obj& point_vn(int vi = -1, int ni = -1) {
-        return p().insert(v_index(vi)).add("//").add(vn_index(ni));
+    std::string filename(int i) const {
+        std::string digits = std::to_string(i);
+        return stem + "." + std::string(digits.size() < 4 ? 4 - digits.size() : 0, '0') + digits + suffix;
     }
 
-    // Add a vertex position and a point element that references it
-    template <typename T> Obj& point2(Vec2<T> a) {
-        return vertex2(a).point();
+    std::string manifest_filename() const {
+        return stem + ".shards";
     }
+};
 
-    // Add a vertex position with the given color and a point element that references it
-    template <typename T> Obj& point2(Vec2<T> a, Color c) {
-        return vertex2(a, c).point();
+//
+// Policies configure a BasicObj at compile time.
+//
+
+// The default policy: the indexing mode and precision are runtime state, see Obj::set_use_negative_indices and
+// Obj::set_precision
+struct DynamicPolicy {
+    static constexpr bool is_static = false;
+};
+
+// Fixes the indexing mode and precision at compile time so that, e.g., computing an index or choosing how to format a
+// float does not branch on runtime state. Calling set_use_negative_indices or set_precision on an Obj using this policy
+// is a compile error, so use a regular Obj if you want to reduce the precision of annotations
+template <bool NegativeIndices, int Precision = std::numeric_limits<double>::max_digits10>
+struct StaticPolicy {
+    static constexpr bool is_static = true;
+    static constexpr bool use_negative_indices = NegativeIndices;
+    static constexpr int precision = Precision;
+};
+
+template <typename Policy = DynamicPolicy> struct BasicObj;
+
+// The type you will normally use, e.g., BasicObj<StaticPolicy<false>> is an Obj which always uses positive indices
+using Obj = BasicObj<>;
+
+//
+// Writes OBJ files and Prizm-specific extensions.
+//
+// See the Prizm::documentation() function for a demo of the API, although it should be self-explanatory.
+//
+// The following page was the reference for the OBJ format: http://paulbourke.net/dataformats/obj/
+// (not everything on that page is implemented). Note Prizm-specific extensions are designed so that
+// OBJ files containing such extensions will always open in other OBJ viewers.
+//
+// You can extend this class by defining a PRIZM_OBJ_CLASS_EXTRA macro, this is mostly useful if
+// you want to add functions chain calls (i.e., obj.function1().function2()). If you don't care
+// about this you can make a regular function
+//
+// If PRIZM_DISABLE is defined this class is stateless and all its functions are empty, so the optimizer removes
+// Prizm calls which you leave in production builds, see the definition below this one
+//
+#ifdef PRIZM_DISABLE
+// Each function accepts any arguments, including explicit template arguments e.g., triangle3<float>(a, b, c), but
+// braced initializer lists cannot be deduced so write e.g., V3{0, 0, 0} rather than {0, 0, 0}. Note the arguments are
+// still evaluated, so avoid passing expensive expressions to Prizm calls you want to compile out
+#define PRIZM_DISABLED_FUNCTION(name) \
+    template <typename T = void, typename U = void, typename... Args> constexpr BasicObj& name(const Args&...) { return *this; }
+
+template <typename Policy> struct BasicObj {
+    constexpr BasicObj() {}
+    constexpr explicit BasicObj(const std::string&, size_t = 0, size_t = 0) {}
+    constexpr explicit BasicObj(std::pmr::memory_resource*) {}
+
+    PRIZM_DISABLED_FUNCTION(add) PRIZM_DISABLED_FUNCTION(insert) PRIZM_DISABLED_FUNCTION(append)
+    PRIZM_DISABLED_FUNCTION(write) PRIZM_DISABLED_FUNCTION(flush)
+    PRIZM_DISABLED_FUNCTION(v) PRIZM_DISABLED_FUNCTION(vn) PRIZM_DISABLED_FUNCTION(vt) PRIZM_DISABLED_FUNCTION(p)
+    PRIZM_DISABLED_FUNCTION(l) PRIZM_DISABLED_FUNCTION(f) PRIZM_DISABLED_FUNCTION(g) PRIZM_DISABLED_FUNCTION(newline)
+    PRIZM_DISABLED_FUNCTION(space) PRIZM_DISABLED_FUNCTION(hash) PRIZM_DISABLED_FUNCTION(bang)
+    PRIZM_DISABLED_FUNCTION(at) PRIZM_DISABLED_FUNCTION(annotation) PRIZM_DISABLED_FUNCTION(comment)
+    PRIZM_DISABLED_FUNCTION(vector2) PRIZM_DISABLED_FUNCTION(vector3) PRIZM_DISABLED_FUNCTION(vector4)
+    PRIZM_DISABLED_FUNCTION(vertex2) PRIZM_DISABLED_FUNCTION(vertex3) PRIZM_DISABLED_FUNCTION(color3)
+    PRIZM_DISABLED_FUNCTION(normal3) PRIZM_DISABLED_FUNCTION(uv2) PRIZM_DISABLED_FUNCTION(tangent3)
+    PRIZM_DISABLED_FUNCTION(point) PRIZM_DISABLED_FUNCTION(point_vn) PRIZM_DISABLED_FUNCTION(point2)
+    PRIZM_DISABLED_FUNCTION(point3) PRIZM_DISABLED_FUNCTION(point3_vn) PRIZM_DISABLED_FUNCTION(points3)
+    PRIZM_DISABLED_FUNCTION(segment) PRIZM_DISABLED_FUNCTION(segment_vn) PRIZM_DISABLED_FUNCTION(segment2)
+    PRIZM_DISABLED_FUNCTION(segment3) PRIZM_DISABLED_FUNCTION(segment3_vn) PRIZM_DISABLED_FUNCTION(segments3)
+    PRIZM_DISABLED_FUNCTION(triangle) PRIZM_DISABLED_FUNCTION(triangle_vn) PRIZM_DISABLED_FUNCTION(triangle_vt)
+    PRIZM_DISABLED_FUNCTION(triangle_vnt) PRIZM_DISABLED_FUNCTION(triangle2) PRIZM_DISABLED_FUNCTION(triangle3)
+    PRIZM_DISABLED_FUNCTION(triangle3_vn) PRIZM_DISABLED_FUNCTION(triangle3_vt) PRIZM_DISABLED_FUNCTION(triangle3_vnt)
+    PRIZM_DISABLED_FUNCTION(mesh3) PRIZM_DISABLED_FUNCTION(vectors3)
+    PRIZM_DISABLED_FUNCTION(polyline) PRIZM_DISABLED_FUNCTION(polyline_vn) PRIZM_DISABLED_FUNCTION(polyline2)
+    PRIZM_DISABLED_FUNCTION(polyline3) PRIZM_DISABLED_FUNCTION(polygon) PRIZM_DISABLED_FUNCTION(polygon2)
+    PRIZM_DISABLED_FUNCTION(polygon3)
+    PRIZM_DISABLED_FUNCTION(box2_min_max) PRIZM_DISABLED_FUNCTION(box3_min_max)
+    PRIZM_DISABLED_FUNCTION(box2_center_extents) PRIZM_DISABLED_FUNCTION(box3_center_extents)
+    PRIZM_DISABLED_FUNCTION(boxes3)
+    PRIZM_DISABLED_FUNCTION(sphere3) PRIZM_DISABLED_FUNCTION(spheres3)
+    PRIZM_DISABLED_FUNCTION(prototype_begin) PRIZM_DISABLED_FUNCTION(prototype_end) PRIZM_DISABLED_FUNCTION(instance)
+    PRIZM_DISABLED_FUNCTION(set_use_negative_indices) PRIZM_DISABLED_FUNCTION(set_thread_count)
+    PRIZM_DISABLED_FUNCTION(set_welding)
+    PRIZM_DISABLED_FUNCTION(set_sample_every) PRIZM_DISABLED_FUNCTION(set_max_elements) PRIZM_DISABLED_FUNCTION(set_max_bytes)
+    PRIZM_DISABLED_FUNCTION(set_region_aabb) PRIZM_DISABLED_FUNCTION(set_region_sphere) PRIZM_DISABLED_FUNCTION(clear_region)
+    PRIZM_DISABLED_FUNCTION(set_quantization) PRIZM_DISABLED_FUNCTION(clear_quantization)
+    PRIZM_DISABLED_FUNCTION(attribute) PRIZM_DISABLED_FUNCTION(command) PRIZM_DISABLED_FUNCTION(item_command)
+    PRIZM_DISABLED_FUNCTION(set_annotations_visible) PRIZM_DISABLED_FUNCTION(set_annotations_color)
+    PRIZM_DISABLED_FUNCTION(set_annotations_scale)
+    PRIZM_DISABLED_FUNCTION(set_vertex_annotations_visible) PRIZM_DISABLED_FUNCTION(set_vertex_index_labels_visible)
+    PRIZM_DISABLED_FUNCTION(set_vertex_position_labels_visible) PRIZM_DISABLED_FUNCTION(set_vertex_label_color)
+    PRIZM_DISABLED_FUNCTION(set_vertex_label_scale)
+    PRIZM_DISABLED_FUNCTION(set_point_annotations_visible) PRIZM_DISABLED_FUNCTION(set_point_index_labels_visible)
+    PRIZM_DISABLED_FUNCTION(set_point_label_color) PRIZM_DISABLED_FUNCTION(set_point_label_scale)
+    PRIZM_DISABLED_FUNCTION(set_segment_annotations_visible) PRIZM_DISABLED_FUNCTION(set_segment_index_labels_visible)
+    PRIZM_DISABLED_FUNCTION(set_segment_label_color) PRIZM_DISABLED_FUNCTION(set_segment_label_scale)
+    PRIZM_DISABLED_FUNCTION(set_triangle_annotations_visible) PRIZM_DISABLED_FUNCTION(set_triangle_index_labels_visible)
+    PRIZM_DISABLED_FUNCTION(set_triangle_label_color) PRIZM_DISABLED_FUNCTION(set_triangle_label_scale)
+    PRIZM_DISABLED_FUNCTION(set_vertices_visible) PRIZM_DISABLED_FUNCTION(set_vertices_color)
+    PRIZM_DISABLED_FUNCTION(set_vertices_size)
+    PRIZM_DISABLED_FUNCTION(set_points_visible) PRIZM_DISABLED_FUNCTION(set_points_color)
+    PRIZM_DISABLED_FUNCTION(set_points_size)
+    PRIZM_DISABLED_FUNCTION(set_point_normals_visible) PRIZM_DISABLED_FUNCTION(set_point_normals_scale)
+    PRIZM_DISABLED_FUNCTION(set_segments_visible) PRIZM_DISABLED_FUNCTION(set_segments_color)
+    PRIZM_DISABLED_FUNCTION(set_segments_width)
+    PRIZM_DISABLED_FUNCTION(set_edges_visible) PRIZM_DISABLED_FUNCTION(set_edges_color)
+    PRIZM_DISABLED_FUNCTION(set_edges_width)
+    PRIZM_DISABLED_FUNCTION(set_triangles_visible) PRIZM_DISABLED_FUNCTION(set_triangles_color)
+
+    std::string to_std_string() const {
+        return {};
     }
 
-    // Add a vertex position and a point element that references it
-    template <typename T> Obj& point3(Vec3<T> a) {
-        return vertex3(a).point();
+    constexpr size_t size() const {
+        return 0;
     }
 
-    // Add a vertex position with the given color and a point element that references it
-    template <typename T> Obj& point3(Vec3<T> a, Color c) {
-        return vertex3(a, c).point();
+    constexpr BasicObj& set_precision(int n = std::numeric_limits<double>::max_digits10, int* old_n = nullptr) {
+        if (old_n) *old_n = n;
+        return *this;
     }
 
-    // Add a vertex position, a normal and an oriented point element referencing them
-    template <typename T> Obj& point3_vn(Vec3<T> va, Vec3<T> na) {
-        return vertex3(va).normal3(na).point_vn();
+    template <typename Float> constexpr BasicObj& set_precision_to_roundtrip_floats(int* old_n = nullptr) {
+        return set_precision(std::numeric_limits<Float>::max_digits10, old_n);
     }
 
+#ifdef PRIZM_OBJ_CLASS_EXTRA
+    PRIZM_OBJ_CLASS_EXTRA
+#endif
+};
+
+#undef PRIZM_DISABLED_FUNCTION
+#else
+template <typename Policy> struct BasicObj {
 
     //
-    // Segment Elements.  Indices are 1-based, see :ObjIndexing
+    // State
     //
 
-    // Add a segment element connecting vertices vi and vj
-    Obj& segment(int vi = -2, int vj = -1) {
-        return l().insert(v_index(vi)).insert(v_index(vj));
-    }
+    // Current contents of the OBJ file, or the end of it if `rope` is not empty
+    Buffer obj;
 
-    // Add an oriented segment element referencing the 2 previous vertex positions and normals (default).
-    // The user can provide explicit indicies to reference vertices vi/ vj and normals ni/nj
-    Obj& segment_vn(int vi = -2, int vj = -1, int ni = -2, int nj = -1) {
-        l();
-        insert(v_index(vi)).add("//").add(vn_index(ni));
-        insert(v_index(vj)).add("//").add(vn_index(nj));
-        return *this;
-    }
+    // Text preceding `obj`, this holds the buffers spliced from other Objs by append(BasicObj&&), which doesn't copy
+    // them. The OBJ file is the concatenation of these buffers followed by `obj`, see for_each_piece
+    std::vector<Buffer> rope;
+    size_t rope_count = 0; // Total size of the buffers in `rope`
 
-    // Add 2 vertex positions and a segment element referencing them
-    template <typename T> Obj& segment2(Vec2<T> a, Vec2<T> b) {
-        return vertex2(a).vertex2(b).segment();
-    }
+    // Number of base-10 digits used to write floating-point numbers, see set_precision(). Use digits() to read this
+    int precision = default_precision();
 
-    // Add 2 vertex positions with the given color and a segment element referencing them
-    template <typename T> Obj& segment2(Vec2<T> a, Vec2<T> b, Color c) {
-        return vertex2(a, c).vertex2(b, c).segment();
-    }
+    // Number of blocks format_block converts with to_chars_float before using the ShortestKernel again, this is set
+    // when most values of a block fall back, e.g., doubles which need 16 or 17 digits
+    int shortest_skip_count = 0;
 
-    // Add 2 vertex positions and a segment element referencing them
-    template <typename T> Obj& segment3(Vec3<T> a, Vec3<T> b) {
-        return vertex3(a).vertex3(b).segment();
-    }
+    // Number of hash characters on the current line, these are significant for Prizm:
+    // 0 hash characters => writing geometry
+    // 1 hash character  => writing an annotation. Prizm stores the text between the first hash and a newline/second hash as an annotation
+    // 2 hash characters => writing a comment. Prizm ignores everything following the second hash character on a line
+    unsigned hash_count = 0;
 
-    // Add 2 vertex positions with the given color and a segment element referencing them
-    template <typename T> Obj& segment3(Vec3<T> a, Vec3<T> b, Color c) {
-        return vertex3(a, c).vertex3(b, c).segment();
-    }
+    // Number of v-directives written to `obj`
+    unsigned v_count = 0;
 
-    // Add 2 vertex positions, 2 vertex normals and an oriented segment element referencing them
-    template <typename T> Obj& segment3_vn(Vec3<T> va, Vec3<T> vb, Vec3<T> na, Vec3<T> nb) {
-        return vertex3(va).normal3(na).vertex3(vb).normal3(nb).segment_vn();
-    }
+    // Number of vn-directives written to `obj`
+    unsigned vn_count = 0;
 
+    // Number of vt-directives written to `obj`
+    unsigned vt_count = 0;
 
+    // If true (default) then functions where the user has not explicity passed indices will use negative indices to refer to vertex data
+    // If false then the the above counts will be used to use positive indices when referring to vertex data.
     //
-    // Triangle Elements.  Indices are 1-based, see :ObjIndexing
+    // Using negative indices is the default because it means the Obj can be concatenated with other Objs (which
+    // must also be using negative indices) to write a single file (see Prizm::Obj::append). The downsides of doing
+    // this is are i) the obj file may not load in viewers other than Prizm since negative indices seem not to be
+    // well supported, and ii) triangles are written as a disconnected soup which increases file size due to
+    // duplicated vertex data (use mesh3 to avoid this)
     //
+    // Use negative_indices() to read this, both it and `precision` are fixed if the Policy is a StaticPolicy
+    bool use_negative_indices = default_use_negative_indices();
 
-    // Add a triangle element referencing the 3 previous vertex positions (default).
-    // The user can provide explicit indicies to reference vertices vi, vj and vk
-    Obj& triangle(int vi = -3, int vj = -2, int vk = -1) {
-        f();
-        insert(v_index(vi));
-        insert(v_index(vj));
-        insert(v_index(vk));
-        return *this;
-    }
+    // If open the Obj is in streaming mode, see the Obj(filename, flush_size) constructor
+    std::ofstream file;
 
-    // Add a triangle element referencing the 3 previous vertex positions and normals (default).
-    // The user can provide explicit indicies to reference vertices vi, vj and vk; and normals ni, nj and nk
-    Obj& triangle_vn(
-        int vi = -3, int vj = -2, int vk = -1, // vertex v-directive  references
-        int ni = -3, int nj = -2, int nk = -1  // normal vn-directive references
-    ) {
-        f();
-        insert(v_index(vi)).add("//").add(vn_index(ni));
-        insert(v_index(vj)).add("//").add(vn_index(nj));
-        insert(v_index(vk)).add("//").add(vn_index(nk));
-        return *this;
-    }
+    // If set the streamed text is compressed, this is set if the streaming filename ends with ".lz4"
+    std::unique_ptr<Lz4Encoder> compressor;
 
-    // Add a triangle element referencing the 3 previous vertex positions and texture vertices (default).
-    // The user can provide explicit indices to reference vertices vi, vj and vk; and texture vertices ti, tj and tk
-    Obj& triangle_vt(
-        int vi = -3, int vj = -2, int vk = -1, // vertex  v-directive  references
-        int ti = -3, int tj = -2, int tk = -1  // texture vt-directive references
-    ) {
-        f();
-        insert(v_index(vi)).add("/").add(vt_index(ti));
-        insert(v_index(vj)).add("/").add(vt_index(tj));
-        insert(v_index(vk)).add("/").add(vt_index(tk));
-        return *this;
-    }
+    // In streaming mode `obj` is written to `file` when a line ends and at least this many bytes are buffered
+    size_t flush_size = std::numeric_limits<size_t>::max();
 
-    // Add a triangle element referencing the 3 previous vertex positions, vertex normals and texture vertices (default).
-    // The user can provide explicit indices reference vertices vi, vj and vk; normals ni, nj and nk; and texture vertices ti, tj and tk
-    Obj& triangle_vnt(
-        int vi = -3, int vj = -2, int vk = -1, // vertex  v-directive  references
-        int ni = -3, int nj = -2, int nk = -1, // normal  vn-directive references
-        int ti = -3, int tj = -2, int tk = -1  // texture vt-directive references
-    ) {
-        f();
-        insert(v_index(vi)).add("/").add(vt_index(ti)).add("/").add(vn_index(ni));
-        insert(v_index(vj)).add("/").add(vt_index(tj)).add("/").add(vn_index(nj));
-        insert(v_index(vk)).add("/").add(vt_index(tk)).add("/").add(vn_index(nk));
-        return *this;
-    }
+    // Number of threads used to format bulk writes (e.g., points3, mesh3) with at least `parallel_min_count` elements,
+    // see set_thread_count
+    int thread_count = 1;
+    int parallel_min_count = 1 << 16;
 
-    // Add 3 vertex positions and a triangle element referencing them
-    template <typename T> Obj& triangle2(Vec2<T> va, Vec2<T> vb, Vec2<T> vc) {
-        return vertex2(va).vertex2(vb).vertex2(vc).triangle();
-    }
+    // If true the soup writers (e.g., triangle3, segment3, polyline3) reuse previously welded vertices with exactly the
+    // same position and color, and normals with exactly the same components, rather than writing new v/vn lines.
+    // See set_welding
+    bool welding = false;
+    std::unordered_map<WeldKey, unsigned, WeldKeyHash> welded_vertices; // Maps to the v-directive index
+    std::unordered_map<WeldKey, unsigned, WeldKeyHash> welded_normals; // Maps to the vn-directive index
+    std::vector<unsigned> element_vertices; // Indices of the element being written in welding mode
+    std::vector<unsigned> element_normals;
 
-    // Add 3 vertex positions with the given color and a triangle element referencing them
-    template <typename T> Obj& triangle2(Vec2<T> va, Vec2<T> vb, Vec2<T> vc, Color c) {
-        return vertex2(va, c).vertex2(vb, c).vertex2(vc, c).triangle();
-    }
+    // Budget for the element writers, see set_sample_every, set_max_elements and set_max_bytes
+    bool budgeted = false;
+    bool skipping = false; // True after an element is dropped, until the next line, so the call chain is skipped
+    uint64_t sample_every = 1;
+    uint64_t sample_countdown = 1; // The element is kept when this reaches 0
+    uint64_t max_elements = std::numeric_limits<uint64_t>::max();
+    size_t max_bytes = std::numeric_limits<size_t>::max();
+    uint64_t kept_count = 0; // Number of elements kept by the budget
+    uint64_t dropped_count = 0; // Number of elements dropped by the budget
+    size_t flushed_count = 0; // Number of bytes written to `file` in streaming mode
 
-    // Add 3 vertex positions and a triangle element referencing them
-    template <typename T> Obj& triangle3(Vec3<T> va, Vec3<T> vb, Vec3<T> vc) {
-        return vertex3(va).vertex3(vb).vertex3(vc).triangle();
-    }
+    // Elements entirely outside this region are dropped, see set_region_aabb and set_region_sphere
+    Region region;
 
-    // Add 3 vertex positions with the given color and a triangle element referencing them
-    template <typename T> Obj& triangle3(Vec3<T> va, Vec3<T> vb, Vec3<T> vc, Color c) {
-        return vertex3(va, c).vertex3(vb, c).vertex3(vc, c).triangle();
-    }
+    // If enabled vertex positions are written as integer grid coordinates, see set_quantization
+    Quantization quantization;
 
-    // Add 3 vertex positions, 3 vertex normals and a triangle element referencing them
-    template <typename T> Obj& triangle3_vn(
-        Vec3<T> va, Vec3<T> vb, Vec3<T> vc,
-        Vec3<T> na, Vec3<T> nb, Vec3<T> nc
-    ) {
-        return vertex3(va).normal3(na).vertex3(vb).normal3(nb).vertex3(vc).normal3(nc).triangle_vn();
-    }
+    // Set in sharded streaming mode, see the Obj(filename, flush_size, shard_size) constructor
+    Shards shards;
 
-    // Add 3 vertex positions, 3 uvs and a triangle element referencing them
-    template <typename T> Obj& triangle3_vt(
-        Vec3<T> va, Vec3<T> vb, Vec3<T> vc,
-        Vec2<T> ta, Vec2<T> tb, Vec2<T> tc
-    ) {
-        return vertex3(va).uv2(ta).vertex3(vb).uv2(tb).vertex3(vc).uv2(tc).triangle_vt();
-    }
+    // True if the last directive was an element. A new shard is only started at a vertex which follows an element so
+    // elements never reference vertices in the previous shard
+    bool after_element = false;
 
-    // Add 3 vertex positions, 3 texture vertices and a triangle element referencing them
-    // @TODO This seems not very useful, perhaps just remove it
-    template <typename T> Obj& triangle3_vt(
-        Vec3<T> va, Vec3<T> vb, Vec3<T> vc,
-        Vec3<T> ta, Vec3<T> tb, Vec3<T> tc
-    ) {
-        return vertex3(va).tangent3(ta).vertex3(vb).tangent3(tb).vertex3(vc).tangent3(tc).triangle_vt();
-    }
+    // If true the bounds of the written vertex positions are accumulated in `written_bounds`, these are the shard bounds
+    bool track_bounds = false;
+    Bounds written_bounds;
 
-    // Add 3 vertex positions, 3 vertex normals, 3 texture vertices and a triangle element referencing them
-    template <typename T> Obj& triangle3_vnt(
-        Vec3<T> va, Vec3<T> vb, Vec3<T> vc,
-        Vec3<T> na, Vec3<T> nb, Vec3<T> nc,
-        Vec3<T> ta, Vec3<T> tb, Vec3<T> tc
-    ) {
-        return vertex3(va).normal3(na).tangent3(ta).vertex3(vb).normal3(nb).tangent3(tb).vertex3(vc).normal3(nc).tangent3(tc).triangle_vnt();
-    }
+    // Value of v_count when prototype_begin was called, or -1 outside prototype declarations
+    int64_t prototype_v_count = -1;
 
 
 
+    //
+    // Basic functions
+    //
 
+    // Constructor. By default write with enough precision to round-trip from float64 to decimal and back
+    // Note: Prizm currently stores mesh data using float32, we will move to float64 so we can show coordinate labels at full precision
+    BasicObj() {}
 
+    // Streaming constructor. Truncates the given file and binds the Obj to it, the buffered text is written to the file
+    // whenever a line ends and at least `flush_size` bytes are buffered. This means memory use is bounded for very large
+    // files and, if your program crashes, the file will contain all the complete lines which were flushed.  The
+    // remaining text is written when you call flush() or when the Obj is destroyed. If the filename ends with ".lz4"
+    // the file is compressed, see write(), and each flush writes a block which is readable after a crash
     //
-    // Polylines. These are sequences of segment elements
+    // If `shard_size` is not zero the text is split into shard files of about this many bytes (before compression),
+    // e.g., if the filename is "dump.obj" they are "dump.0000.obj", "dump.0001.obj" etc. A new shard is started at the
+    // first vertex following an element once the current shard is full, so with negative indices (the default) every
+    // shard is a valid OBJ file, and the concatenation of the shards is the file you would get without sharding. A
+    // manifest "dump.shards", listing the shards with their vertex counts and bounding boxes, is updated as each shard
+    // is started and finished, so after a crash it also lists the shard being written, without its vertex count and
+    // bounding box. Load the manifest in the viewer to load all the shards. Note: Elements must not reference vertices
+    // written before a previous element, which is the case for all the functions writing elements in this file.
     //
-
-    // Add a polyline element referencing the previous N vertex positions
-    // N should be at least 2
-    Obj& polyline(int N, bool closed = false) {
-        if (N < 2) return *this;
-        l(); // Start the element
-        for (int i = -N; i < 0; i++) insert(v_index(i)); // Continue the element
-        if (closed) insert(v_index(-N)); // Close the polyline
-        return *this;
+    // Note: In this mode to_std_string() and append() only see the text which has not yet been flushed
+    explicit BasicObj(const std::string& filename, size_t flush_size = 1 << 20, size_t shard_size = 0) : flush_size(flush_size) {
+        if (shard_size > 0) {
+            shards.max_size = shard_size;
+            shards.set_filename(filename);
+            track_bounds = true;
+        }
+        file.open(shard_size > 0 ? shards.filename(0) : filename, std::ofstream::out | std::ofstream::trunc | std::ofstream::binary);
+        if (shard_size > 0) write_manifest();
+        if (is_lz4_filename(filename)) compressor = std::make_unique<Lz4Encoder>();
     }
 
-    // Add an oriented polyline element referencing the previous N vertex positions and normals
-    // N should be at least 2
-    Obj& polyline_vn(int N, bool closed = false) {
-        if (N < 2) return *this;
-        l(); // Start the element
-        for (int i = -N; i < 0; i++) insert(v_index(i)).add("//").add(vn_index(i)); // Continue the element
-        if (closed) insert(v_index(-N)).add("//").add(vn_index(-N)); // Close the polyline
+    // Allocate the text of the OBJ file from `resource` e.g., an arena which you reset after each iteration of a hot
+    // loop. The resource must outlive the Obj. See Buffer
+    explicit BasicObj(std::pmr::memory_resource* resource) : obj(resource) {}
+
+    BasicObj(BasicObj&&) = default;
+
+    // In streaming mode this Obj is finished as if it was destroyed, i.e., the remaining text is flushed and the lz4
+    // frame and shard manifest are completed, before it takes over `other`
+    BasicObj& operator=(BasicObj&& other) {
+        if (this != &other) {
+            this->~BasicObj();
+            new (this) BasicObj(std::move(other));
+        }
         return *this;
     }
 
-    // Add a polyline element referencing the vertices with the given indicies
-    Obj& polyline(int N, int i, int j, ...) {
-        segment(i, j); // Start the element
-        va_list va;
-        va_start(va, j);
-        for (int n = 0; n < N-2; n++) insert(va_arg(va, int)); // Continue the element
-        va_end(va);
-        return *this;
+    ~BasicObj() {
+        if (file.is_open()) {
+            std::string annotation = budget_annotation();
+            obj.append(annotation.data(), annotation.size());
+        }
+        flush();
+        if (compressor && file.is_open()) {
+            compressor->end_frame();
+            file.write(compressor->frame.data, compressor->frame.count);
+        }
+        if (shards.max_size > 0 && file.is_open()) {
+            file.close();
+            finish_shard();
+            write_manifest();
+        }
     }
 
-    // Add N vertex positions, described by the given 2D coordinate buffer, and a polyline element referencing them.
-    // N should be at least 2. If closed is true write the first point index again to close the polyline
-    template <typename T> Obj& polyline2(int N, T* XYs, bool closed = false) {
-        return poly_impl('l', N, XYs, 2, closed);
+    // Add anything to the OBJ file. Numbers, strings and Prizm types are formatted directly into the buffer, any other
+    // type is written using its operator<<
+    template <typename T> BasicObj& add(const T& anything) {
+        if (skipping) return *this;
+        format(anything);
+        return *this;
     }
 
-    // Add N vertex positions, described by the given 3D coordinate buffer, and a polyline element referencing them.
-    // N should be at least 2. If closed is true write the first point index again to close the polyline
-    template <typename T> Obj& polyline3(int N, T* XYZs, bool closed = false) {
-        return poly_impl('l', N, XYZs, 3, closed);
+    // Add anything to the OBJ file using operator<< but prefix with a space character
+    template <typename T> BasicObj& insert(const T& anything) {
+        if (skipping) return *this;
+        return space().add(anything);
     }
 
-    // Add the given 2D vertex positions and a polyline element referencing them
-    // @TODO Test if this can this be called with only two points
-    template <typename T> Obj& polyline2(int N, Vec2<T> p1, Vec2<T> p2, Vec2<T> p3, ...) {
-        va_list va;
-        va_start(va, p3);
-        vertex2_variadic(N, p1, p2, p3, va);
-        va_end(va);
-        return polyline(N);
+    // Add a newline, then add the `other` Obj and then add another newline
+    // Note: `other` must exclusively use negative (aka relative) indices
+    BasicObj& append(const BasicObj& other) {
+        newline();
+        other.for_each_piece([this](const char* data, size_t count) { obj.append(data, count); });
+        add_counts(other);
+        return newline();
+    }
+
+    // As above but `other` is moved, so its buffers are spliced without copying them (unless they are small). This
+    // means the cost of combining many Objs, e.g., one per step of an algorithm, does not depend on their size.
+    // Note: If `other` allocates from a memory resource the resource must outlive this Obj
+    BasicObj& append(BasicObj&& other) {
+        newline();
+        for (Buffer& buffer : other.rope) {
+            splice(std::move(buffer));
+        }
+        splice(std::move(other.obj));
+        other.rope.clear();
+        other.rope_count = 0;
+        add_counts(other);
+        return newline();
     }
 
-    // Add the given 3D vertex positions and a polyline element referencing them
-    // @TODO Test if this can this be called with only two points
-    template <typename T> Obj& polyline3(int N, Vec3<T> p1, Vec3<T> p2, Vec3<T> p3, ...) {
-        va_list va;
-        va_start(va, p3);
-        vertex3_variadic(N, p1, p2, p3, va);
-        va_end(va);
-        return polyline(N);
-    }
 
 
 
 
+    //
+    // Output functions
+    //
 
+    // Write data to a file
     //
-    // Convex Polygons. These are sequences of triangle elements aka triangle fans
+    // Tip: Use format string "%05d" to write an int padded with zeros to width 5. This is useful for logging the
+    // progress of an algorithm, you will also need to use the same prefix and you may need to run the
+    // `sort_by_name` console command in Prizm to put the item list into a state where you can use Ctrl LMB or
+    // Shift LMB while sweeping the cursor over the visibility checkboxes to create a progress animation. If you have
+    // many iterations use Prizm::FrameWriter instead, which writes a single file the viewer shows with a frame slider.
     //
+    // If the filename ends with ".lz4", e.g., "debug.obj.lz4", the file is compressed using the LZ4 frame format, see
+    // Lz4Encoder. This is recommended for large files which would otherwise be limited by the disk speed, the viewer
+    // decompresses them when they are loaded
+    //
+    // If the filename ends with ".prizmb" the OBJ text is converted to the binary format described at obj_to_prizmb,
+    // which the viewer loads without parsing any text. The conversion parses the text, so this makes writing slower
+    // and only pays off for files which are loaded repeatedly, or are too large for the viewer to parse quickly. Requires
+    // PRIZM_API_IMPLEMENTATION in one translation unit
+    BasicObj& write(std::string filename) {
+        if (is_prizmb_filename(filename)) {
+            std::string prizmb = obj_to_prizmb(to_std_string());
+            std::ofstream file;
+            file.open(filename, std::ofstream::out | std::ofstream::trunc | std::ofstream::binary);
+            file.write(prizmb.data(), prizmb.size());
+            return *this;
+        }
 
-    // Add a polygon element referencing the previous N vertices.
-    // N should be at least 3
-    Obj& polygon(int N) {
-        if (N < 3) return *this;
-        f(); // Start the element
-        for (int i = -N; i < 0; i++) insert(v_index(i)); // Continue the element
-        return *this;
-    }
+        if (is_lz4_filename(filename)) {
+            Lz4Encoder encoder;
+            for_each_piece([&encoder](const char* data, size_t count) { encoder.add(data, count); });
+            std::string annotation = budget_annotation();
+            encoder.add(annotation.data(), annotation.size());
+            encoder.end_frame();
+            std::ofstream file;
+            file.open(filename, std::ofstream::out | std::ofstream::trunc | std::ofstream::binary);
+            file.write(encoder.frame.data, encoder.frame.count);
+            return *this;
+        }
 
-    // Add a polygon element referencing the vertices with the given indices.
-    Obj& polygon(int N, int i, int j, int k, ...) {
-        triangle(i, j, k); // Start the element
-        va_list va;
-        va_start(va, k);
-        for (int n = 0; n < N-3; n++) insert(va_arg(va, int)); // Continue the element
-        va_end(va);
+#ifdef _WIN32
+        std::ofstream file;
+        file.open(filename, std::ofstream::out | std::ofstream::trunc | std::ofstream::binary);
+        for_each_piece([&file](const char* data, size_t count) { file.write(data, count); });
+        std::string annotation = budget_annotation();
+        file.write(annotation.data(), annotation.size());
+        file.close();
+#else
+        // Write all the pieces with as few system calls as possible
+        int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd >= 0) {
+            std::vector<iovec> pieces;
+            for_each_piece([&pieces](const char* data, size_t count) {
+                pieces.push_back(iovec{const_cast<char*>(data), count});
+            });
+            std::string annotation = budget_annotation();
+            pieces.push_back(iovec{annotation.data(), annotation.size()});
+            write_pieces(fd, pieces.data(), pieces.size());
+            close(fd);
+        }
+#endif
         return *this;
     }
 
-    // Add N vertex positions, described by the given 2D coordinate buffer, and a polygon element referencing them
-    // N should be at least 3
-    template <typename T> Obj& polygon2(int N, T* XYs) {
-        return poly_impl('f', N, XYs, 2);
+    // In streaming mode write the buffered text to the file and empty the buffer, otherwise do nothing
+    BasicObj& flush() {
+        if (file.is_open()) {
+            if (compressor) {
+                for_each_piece([this](const char* data, size_t count) { compressor->add(data, count); });
+                compressor->end_block();
+                file.write(compressor->frame.data, compressor->frame.count);
+                compressor->frame.clear();
+            } else {
+                for_each_piece([this](const char* data, size_t count) { file.write(data, count); });
+            }
+            file.flush();
+            flushed_count += size();
+            obj.clear();
+            rope.clear();
+            rope_count = 0;
+        }
+        return *this;
     }
 
-    // Add N vertex positions, described by the given 3D coordinate buffer, and a polygon element referencing them
-    // N should be at least 3
-    template <typename T> Obj& polygon3(int N, T* XYZs) {
-        return poly_impl('f', N, XYZs, 3);
+    // Returns the current state of the Obj as a std::string
+    std::string to_std_string() const {
+        std::string result;
+        result.reserve(size());
+        for_each_piece([&result](const char* data, size_t count) { result.append(data, count); });
+        result += budget_annotation();
+        return result;
     }
 
-    // Add the given 2D vertex positions and a polygon element referencing them
-    template <typename T> Obj& polygon2(int N, Vec2<T> p1, Vec2<T> p2, Vec2<T> p3, ...) {
-        va_list va;
-        va_start(va, p3);
-        vertex2_variadic(N, p1, p2, p3, va);
-        va_end(va);
-        return polygon(N);
+    // Returns the size of the OBJ file in bytes
+    size_t size() const {
+        return rope_count + obj.count;
     }
 
-    // Add the given 3D vertex positions and a polygon element referencing them
-    template <typename T> Obj& polygon3(int N, Vec3<T> p1, Vec3<T> p2, Vec3<T> p3, ...) {
-        va_list va;
-        va_start(va, p3);
-        vertex3_variadic(N, p1, p2, p3, va);
-        va_end(va);
-        return polygon(N);
+    // Call `f(const char* data, size_t count)` for each piece of the OBJ file, in order
+    template <typename F> void for_each_piece(const F& f) const {
+        for (const Buffer& buffer : rope) {
+            f(buffer.data, buffer.count);
+        }
+        if (obj.count) f(obj.data, obj.count);
     }
 
 
 
 
-
     //
-    // Axis-aligned Boxes.
+    // Directives and special characters/strings
     //
 
-    // Add a 2D box region defined by min/max, visualized with segment elements
-    template <typename T> Obj& box2_min_max(Vec2<T> min, Vec2<T> max) {
-        return polyline2(5, min, Vec2<T>{max.x,min.y}, max, Vec2<T>{min.x,max.y}, min);
+    // Add a vertex directive to start a vertex on a new line
+    BasicObj& v() {
+        if (!welding) maybe_start_next_shard(); // Welded elements start a shard in admit_budget, before any lookup
+        after_element = false;
+        v_count += 1;
+        return newline().add('v');
     }
 
-    // Add a 3D box region defined by min/max, visualized with segment elements
-    template <typename T> Obj& box3_min_max(Vec3<T> min, Vec3<T> max) {
-        // This has some redundant edges but having them means we could annotate all segments in the shape conveniently
-        Vec3<T> p000{min.x, min.y, min.z}, p100{max.x, min.y, min.z}, p010{min.x, max.y, min.z}, p110{max.x, max.y, min.z};
-        Vec3<T> p001{min.x, min.y, max.z}, p101{max.x, min.y, max.z}, p011{min.x, max.y, max.z}, p111{max.x, max.y, max.z};
-        return polyline3(16, p000, p100, p110, p010, p000, p001, p101, p100, p101, p111, p110, p111, p011, p010, p011, p001);
+    // Add a vertex normal directive on a new line
+    BasicObj& vn() {
+        vn_count += 1;
+        return newline().add("vn");
     }
 
-    // Add a 2D box region defined by a center point and extents vector (box side lengths), visualized with segment elements
-    template <typename T> Obj& box2_center_extents(Vec2<T> center, Vec2<T> extents) {
-        return box2_min_max<T>(
-            {center.x - extents.x/2, center.y - extents.y/2},
-            {center.x + extents.x/2, center.y + extents.y/2});
+    // Add a texture vertex directive on a new line
+    BasicObj& vt() {
+        vt_count += 1;
+        return newline().add("vt");
     }
 
-    // Add a 3D box region defined by a center point and extents vector (box side lengths), visualized with segment elements
-    template <typename T> Obj& box3_center_extents(Vec3<T> center, Vec3<T> extents) {
-        return box3_min_max<T>(
-            {center.x - extents.x/2, center.y - extents.y/2, center.z - extents.z/2},
-            {center.x + extents.x/2, center.y + extents.y/2, center.z + extents.z/2});
+    // Add a point directive to start a point on a new line
+    BasicObj& p() {
+        after_element = true;
+        return newline().add('p');
     }
 
+    // Add a line directive to start a segment/polyline on a new line
+    BasicObj& l() {
+        after_element = true;
+        return newline().add('l');
+    }
 
+    // Add a face directive to start a triangle/polygon on a new line
+    BasicObj& f() {
+        after_element = true;
+        return newline().add('f');
+    }
 
+    // Add a group directive on the current line
+    // Note: Currently Prizm ignores these
+    BasicObj& g() {
+        return newline().add('g');
+    }
+
+    // Add a newline to the obj and reset hash_count
+    BasicObj& newline(int count = 1) {
+        skipping = false;
+        while (count > 0) {
+            hash_count = 0;
+            add("\n");
+            count -= 1;
+        }
+        if (size() >= flush_size) {
+            flush();
+        }
+        return *this;
+    }
+
+    // Add a space to the obj
+    BasicObj& space() {
+        return add(' ');
+    }
+
+    // Add a # character to the current line, this is used for annotations, comments and attributes
+    BasicObj& hash(int count = 1) {
+        while (count > 0) {
+            hash_count += 1;
+            add("#");
+            count -= 1;
+        }
+        return *this;
+    }
+
+    // Add a ! character to the current line, this is used by command annotations
+    BasicObj& bang() {
+        return add('!');
+    }
+
+    // Add an @ character to the current line, this is used for attributes
+    BasicObj& at() {
+        return add('@');
+    }
 
-    //
-    // Shapes.
-    //
 
-    // Add a sphere with the given center and radius visualized with triangle elements
-    // The resolution of the sphere is determined by `slices` (an orange) and `stacks` (of a wedding cake)
-    Obj& sphere3(V3f center, float radius, int slices, int stacks);
 
 
 
 
     //
-    // Obj file configuration functions
+    // Annotations.
     //
+    // In Prizm the text between the first hash and a newline or second hash is an 'annotation string' and can be shown in the viewport.
 
-    // Set the number of base-10 digits used to write floating-point numbers to the obj. By default this function is
-    // equivalent to calling `set_precision_to_roundtrip_floats<double>()`
-    //
-    // This function is useful to improve annotation readability by reducing the number of base-10 digits used to write
-    // float data.  After writing such an annotation you will probably want to restore the value used for coordinate
-    // data, probably by calling this function with no arguments, to restore the precision that round-trips from double
-    // to decimal text to double.
-    Obj& set_precision(int n = std::numeric_limits<double>::max_digits10, int* old_n = nullptr) {
-        int old_precision = static_cast<int>(obj.precision(n));
-        if (old_n) *old_n = old_precision;
+    // Start an annotation: If there is no hash character on the current line add one, otherwise do nothing
+    BasicObj& annotation() {
+        if (hash_count == 0 && !skipping) {
+            // Add a space here to help other obj viewers which might fail to parse numbers not delimited by whitespace
+            space().hash();
+        }
         return *this;
     }
 
-    // Set the number of base-10 digits used to write floating-point numbers to the obj to a value which can round-trip
-    // from Float to decimal text to Float.
-    template <typename Float> Obj& set_precision_to_roundtrip_floats(int* old_n = nullptr) {
-        static_assert(std::is_floating_point<Float>::value);
-
-        // "Unlike most mathematical operations, the conversion of a floating-point value to text and back is exact as long
-        // as at least max_digits10 were used (9 for float, 17 for double): it is guaranteed to produce the same
-        // floating-point value, even though the intermediate text representation is not exact. It may take over a hundred
-        // decimal digits to represent the precise value of a float in decimal notation."
-        // https://en.cppreference.com/w/cpp/types/numeric_limits/max_digits10
-        return set_precision(std::numeric_limits<Float>::max_digits10, old_n);
+    // Add an annotation containing the given data to the obj. See annotation()
+    template <typename T> BasicObj& annotation(const T& data) {
+        return annotation().insert(data);
     }
 
-    // See documentation for `use_negative_indices` member
-    Obj& set_use_negative_indices(bool value) {
-        use_negative_indices = value;
-        return *this;
-    }
 
 
 
 
     //
-    // Attributes.
+    // Comments.
     //
-    // Attributes are special annotions which are intended to encode numerical data types/colors in annotation strings
-    // by prefixing them with an @ character.  In a future version of Prizm there will be function to parse the encoded
-    // data in order to display or process them specially. Multiple distinct data types placed on the same geometry
-    // element will be supported and the @ character will be used parse them.  Even before this is implemented you might
-    // still prefer to use attributes to annotations if you find having the @ prefix helps you read your annotations
-    // strings more clearly. See Prizm::documentation() for more details.
+    // In Prizm any text that follows the second # on a line is ignored
     //
 
-    // Start an attribute: Start an annotation string if needed, then add an @ to introduce a new attribute
-    Obj& attribute() {
-        return annotation().space().at();
+    // Ensure there are two hash characters on the current line
+    BasicObj& comment() {
+        while (hash_count < 2) {
+            hash();
+        }
+        return *this;
     }
 
-    // Add an attribute containing the given data to the obj.  Data should be a numerical data type, see attribute()
-    template <typename T> Obj& attribute(const T& data) {
-        // Add a space is for legibility.
-        return attribute().insert(data);
+    // Ensure there are two # characters on the current line then insert the comment content
+    template <typename T> BasicObj& comment(T content) {
+        return comment().insert(content);
     }
 
 
 
 
     //
-    // Command Annotations.
-    //
-    // Command Annotations are special annotations which start with #! on a newline (this syntax is inspired by the
-    // "hashbang" character sequence used to introduce an interpreter directive on Unix) and allow you specify Prizm
-    // console commands, with arguments, which should be executed immediately after an the obj file has been loaded.
-    // Command annotations provide a convenient way to configure the item display settings and save you a few clicks.
-    // For example, if you know you want to look annotations you can call `set_annotation_label_visible(true)` to add
-    // a command annotation which will enable annotation visibility after the file is loaded (annotation labelling is
-    // off by default). Note: You can call these functions whenever you like, the command will be written to this->obj
-    // at the point you call them but Prizm will defer execution until the entire file has been parsed.
-    //
-    // (Advanced Note) If you look at the output OBJ file you will notice that command annotations which configure
-    // item state start with a 0, this is a Prizm item index.  The Prizm application has a global array of items
-    // (aka meshes) and the index into this list is often used as the first argument in console commands. When console
-    // commands are executed by the function which load OBJ files as command annotations a _local_ array of items is
-    // created, the item with local index 0 is the item with geometry given in the OBJ if a console command which has
-    // a side effect of generating a new item is executed as a command annotation then this item will have index >0 and
-    // you can pass that value (e.g., to the `item_command` function) to run a console command on one of these
-    // generated items which are not explicitly in the OBJ file.  Note: This complexity is intentionally avoided in
-    // the Prizm::Obj command annotation API, so the functions below are hardcoded to work with item 0 only, but you
-    // can do something like `obj.command("my_command").insert(1).insert("string_argument")` to run "my_command" on the
-    // item with index 1.
+    // Vectors
     //
 
-    // Start a command annotation, arguments should be `insert`ed after this
-    Obj& command(const std::string& command_name) {
-        return newline().hash().bang().insert(command_name);
+    // Add 2D vector
+    // Note: writes " x y" to the obj
+    template <typename T> BasicObj& vector2(T x, T y) {
+        return vector2(Vec2<T>(x, y));
     }
 
-    // Start a command annotation whose first argument is a Prizm item index (See the Advanced Note above)
-    Obj& item_command(const std::string& command_name, int item_index = 0) {
-        return command(command_name).insert(item_index);
+    // Add 2D vector
+    // Note: writes " v.x v.y" to the obj
+    template <typename T> BasicObj& vector2(Vec2<T> v) {
+        return insert(v);
     }
 
-    // Annotation labels.  These functions affect annotations on every geometric entity, there are more granular functions as well
+    // Add 3D vector
+    // Note: writes " x y z" to the obj
+    template <typename T> BasicObj& vector3(T x, T y, T z) {
+        return vector3(Vec3<T>(x, y, z));
+    }
 
-    // Set visibility of all annotations
-    Obj& set_annotations_visible(bool visible) {
-        return item_command("set_annotations_visible").insert((int)visible);
+    // Add 3D vector
+    // Note: writes " v.x v.y v.z" to the obj
+    template <typename T> BasicObj& vector3(Vec3<T> v) {
+        return insert(v);
     }
 
-    // Set color of all annotation text
-    Obj& set_annotations_color(Color color) {
-        return item_command("set_annotations_color").insert(color);
+    // Add 4D vector
+    // Note: writes " x y z w" to the obj
+    template <typename T> BasicObj& vector4(T x, T y, T z, T w) {
+        return vector4(Vec4<T>(x, y, z, w));
     }
 
-    // Set scale of all annotation text
-    // The scale parameter is a float in the range [0.2, 1.0], by default Prizm uses 0.4.
-    // TODO :FixScaleParameter The scale parameter is weird, use size in pixels instead
-    Obj& set_annotations_scale(float scale) {
-        return item_command("set_annotations_scale").insert(scale);
+    // Add 4D vector
+    // Note: writes " v.x v.y v.z v.w" to the obj
+    template <typename T> BasicObj& vector4(Vec4<T> v) {
+        return insert(v);
     }
 
 
-    // Vertex labels
-
-    // Set visibility of vertex annotations i.e., annotations on obj file v-directive data
-    Obj& set_vertex_annotations_visible(bool visible) {
-        return item_command("set_vertex_annotations_visible").insert((int)visible);
-    }
 
-    //set_vertex_annotations_color not implemented (do we want this granularity? using set_annotations_color seems sufficient)
-    //set_vertex_annotations_scale not implemented (do we want this granularity? using set_annotations_scale seems sufficient)
 
-    // Set visibility of vertex index labels i.e., 0-based indices into the obj file v-directive data
-    Obj& set_vertex_index_labels_visible(bool visible) {
-        return item_command("set_vertex_index_labels_visible").insert((int)visible);
-    }
+    //
+    // Vertices/Positions.
+    //
+    // :ObjIndexing Vertex indexing is 1-based and can be negative:
+    // * If index >  0 the index refers to the index-th added vertex
+    // * If index <  0 the index refers to index-th preceeding vertex relative to line containing the element with the reference
+    // * if index == 0 the index is invalid, this is a (silent!) error
+    // Vertices should be referenced by elements that are written later in the obj file
+    //
 
-    // Set visibility of vertex position labels i.e., the coordinates of the obj file v-directive data
-    Obj& set_vertex_position_labels_visible(bool visible) {
-        return item_command("set_vertex_position_labels_visible").insert((int)visible);
+    // Add a 2D position
+    // Note: writes "\nv a.x a.y" to the obj
+    template <typename T> BasicObj& vertex2(Vec2<T> a) {
+        return v().position(a);
     }
 
-    // Set color of vertex index/position labels
-    Obj& set_vertex_label_color(Color color) {
-        return item_command("set_vertex_label_color").insert(color);
+    // Add a 3D position
+    // Note: writes "\nv a.x a.y a.z" to the obj
+    template <typename T> BasicObj& vertex3(Vec3<T> a) {
+        return v().position(a);
     }
 
-    // Set scale of vertex index/position labels
-    // The scale parameter is a float in the range [0.2, 1.0], by default Prizm uses 0.4 (see :FixScaleParameter)
-    Obj& set_vertex_label_scale(float scale) {
-        return item_command("set_vertex_label_scale").insert(scale);
+    // Add a 2D position with color
+    // Note: writes "\nv a.x a.y c.r c.g c.b" to the obj, see color3
+    template <typename T> BasicObj& vertex2(Vec2<T> a, Color c) {
+        return v().position(a).color3(c);
     }
 
-
-    // Point labels
-
-    // Set visibility of point annotations i.e., annotations on obj file p-directive data
-    Obj& set_point_annotations_visible(bool visible) {
-        return item_command("set_point_annotations_visible").insert((int)visible);
+    // Add a 3D position with color
+    // Note: writes "\nv a.x a.y a.z c.r c.g c.b" to the obj, see color3
+    template <typename T> BasicObj& vertex3(Vec3<T> a, Color c) {
+        return v().position(a).color3(c);
     }
 
-    //set_point_annotations_color not implemented (do we want this granularity? using set_annotations_color seems sufficient)
-    //set_point_annotations_scale not implemented (do we want this granularity? using set_annotations_scale seems sufficient)
-
-    // Set visibility of point element index labels i.e., 0-based indices into the obj file p-directive data
-    // Note: set_vertex_index_labels_visible is probably the function you want!
-    Obj& set_point_index_labels_visible(bool visible) {
-        return item_command("set_point_index_labels_visible").insert((int)visible);
+    // Add a vertex color
+    // Note: writes " c.r c.g c.b" to the obj with components rescaled to the range [0,1] expected by OBJ viewers
+    BasicObj& color3(Color c) {
+        return vector3(c.r / 255.f, c.g / 255.f, c.b / 255.f);
     }
 
-    // Set color of point index labels
-    // Note: set_vertex_label_color is probably the function you want!
-    Obj& set_point_label_color(Color color) {
-        return item_command("set_point_label_color").insert(color);
-    }
 
-    // Set scale of point index labels
-    // The scale parameter is a float in the range [0.2, 1.0], by default Prizm uses 0.4 (see :FixScaleParameter)
-    // Note: set_vertex_label_scale is probably the function you want!
-    Obj& set_point_label_scale(float scale) {
-        return item_command("set_point_label_scale").insert(scale);
-    }
 
 
-    // Segment labels
+    //
+    // Normals, Textures, Tangents. Indexing is 1-based, see :ObjIndexing
+    //
 
-    // Set visibility of segment annotations i.e., annotations on obj file l-directive data
-    Obj& set_segment_annotations_visible(bool visible) {
-        return item_command("set_segment_annotations_visible").insert((int)visible);
+    // Add a 3D normal
+    // Note: writes "\nvn n.x n.y n.z" to the obj
+    template <typename T> BasicObj& normal3(Vec3<T> n) {
+        return vn().vector3(n);
     }
 
-    //set_segment_annotations_color not implemented (do we want this granularity? using set_annotations_color seems sufficient)
-    //set_segment_annotations_scale not implemented (do we want this granularity? using set_annotations_scale seems sufficient)
-
-    // Set visibility of segment element index labels i.e., 0-based indices into the obj file l-directive data
-    Obj& set_segment_index_labels_visible(bool visible = true) {
-        return item_command("set_segment_index_labels_visible").insert((int)visible);
+    // Add a UV coordinate (2D texture vertex)
+    // Note: writes "\nvt t.x t.y" to the obj
+    template <typename T> BasicObj& uv2(Vec2<T> t) {
+        return vt().vector2(t);
     }
 
-    // Set color of segment index labels
-    Obj& set_segment_label_color(Color color) {
-        return item_command("set_segment_label_color").insert(color);
+    // Add a 3D tangent (3D texture vertex)
+    // Note: writes "\nvt t.x t.y t.z" to the obj
+    // @TODO Rename to uvw or uv3?
+    template <typename T> BasicObj& tangent3(Vec3<T> t) {
+        return vt().vector3(t);
     }
 
-    // Set scale of segment index labels
-    // The scale parameter is a float in the range [0.2, 1.0], by default Prizm uses 0.4 (see :FixScaleParameter)
-    Obj& set_segment_label_scale(float scale) {
-        return item_command("set_segment_label_scale").insert(scale);
-    }
 
 
-    // Triangle labels
+    //
+    // Point Elements.  Indices are 1-based, see :ObjIndexing
+    //
 
-    // Set visibility of triangle annotations i.e., annotations on obj file f-directive data
-    Obj& set_triangle_annotations_visible(bool visible) {
-        return item_command("set_triangle_annotations_visible").insert((int)visible);
+    // Add a point element referencing the i-th vertex position
+    BasicObj& point(int i = -1) {
+        return p().insert(v_index(i));
     }
 
-    //set_triangle_annotations_color not implemented (do we want this granularity? using set_annotations_color seems sufficient)
-    //set_triangle_annotations_scale not implemented (do we want this granularity? using set_annotations_scale seems sufficient)
-
-    // Set visibility of triangle element index labels i.e., 0-based indices into the obj file f-directive data
-    Obj& set_triangle_index_labels_visible(bool visible = true) {
-        return item_command("set_triangle_index_labels_visible").insert((int)visible);
+    // Add a oriented point element referencing the previous vertex position and normal (default).
+    // The user can provide explicit indicies to reference vertex vi and normal ni
+    BasicObj& point_vn(int vi = -1, int ni = -1) {
+        return p().insert(v_index(vi)).add("//").add(vn_index(ni));
     }
 
-    // Set color of triangle index labels
-    Obj& set_triangle_label_color(Color color) {
-        return item_command("set_triangle_label_color").insert(color);
+    // Add a vertex position and a point element that references it
+    template <typename T> BasicObj& point2(Vec2<T> a) {
+        if (!admit(a)) return *this;
+        if (welding) return weld(a).welded_element('p');
+        return vertex2(a).point();
     }
 
-    // Set scale of triangle index labels
-    // The scale parameter is a float in the range [0.2, 1.0], by default Prizm uses 0.4 (see :FixScaleParameter)
-    Obj& set_triangle_label_scale(float scale) {
-        return item_command("set_triangle_label_scale").insert(scale);
+    // Add a vertex position with the given color and a point element that references it
+    template <typename T> BasicObj& point2(Vec2<T> a, Color c) {
+        if (!admit(a)) return *this;
+        if (welding) return weld(a, &c).welded_element('p');
+        return vertex2(a, c).point();
     }
 
-
-    // Vertex rendering
-
-    // Set visibility of vertices i.e., obj file v-directive data
-    Obj& set_vertices_visible(bool visible = true) {
-        return item_command("set_vertices_visible").insert((int)visible);
+    // Add a vertex position and a point element that references it
+    template <typename T> BasicObj& point3(Vec3<T> a) {
+        if (!admit(a)) return *this;
+        if (welding) return weld(a).welded_element('p');
+        return vertex3(a).point();
     }
 
-    // Set color of vertices i.e., obj file v-directive data
-    Obj& set_vertices_color(Color color) {
-        return item_command("set_vertices_color").insert(color);
+    // Add a vertex position with the given color and a point element that references it
+    template <typename T> BasicObj& point3(Vec3<T> a, Color c) {
+        if (!admit(a)) return *this;
+        if (welding) return weld(a, &c).welded_element('p');
+        return vertex3(a, c).point();
     }
 
-    // Set size/radius of vertices i.e., obj file v-directive data
-    Obj& set_vertices_size(int size) {
-        return item_command("set_vertices_size").insert(size);
+    // Add a vertex position, a normal and an oriented point element referencing them
+    template <typename T> BasicObj& point3_vn(Vec3<T> va, Vec3<T> na) {
+        if (!admit(va)) return *this;
+        return vertex3(va).normal3(na).point_vn();
     }
 
+    // Add the vertex positions in the given view and a point element referencing each of them
+    // If `colors` is not empty it should have the same count as `positions`, see color_at
+    template <typename T, typename C = uint8_t> BasicObj& points3(Strided<T, 3> positions, Strided<C, 3> colors = {}) {
+        if (region.kind != Region::NONE) {
+            std::vector<int> kept;
+            for (int i = 0; i < positions.count; i++) {
+                Bounds bounds;
+                bounds.add(positions, i);
+                if (region.overlaps(bounds)) kept.push_back(i);
+            }
+            std::vector<T> kept_positions;
+            std::vector<C> kept_colors;
+            return without_region([&] {
+                points3(positions.gather(kept, kept_positions), colors.gather(kept, kept_colors));
+            });
+        }
 
-    // Point rendering
-
-    // Set visibility of points i.e., obj file p-directive data
-    // Note: set_vertices_visible is probably the function you want!
-    Obj& set_points_visible(bool visible) {
-        return item_command("set_points_visible").insert((int)visible);
-    }
-
-    // Set color of points i.e., obj file p-directive data
-    // Note: set_vertices_color is probably the function you want!
-    Obj& set_points_color(Color color) {
-        return item_command("set_points_color").insert(color);
-    }
+        return parallel_impl(positions.count, [&](BasicObj& chunk, int begin, int end) {
+            chunk.v_count += begin;
+            if (colors || chunk.quantization.enabled) {
+                for (int i = begin; i < end; i++) {
+                    chunk.v().position_at(positions, i);
+                    if (colors) chunk.color_at(colors, i);
+                    chunk.point();
+                }
+                return;
+            }
 
-    // Set size/radius of points i.e., obj file p-directive data
-    // Note: set_vertices_size is probably the function you want!
-    Obj& set_points_size(int size) {
-        return item_command("set_points_size").insert(size);
-    }
+            // The coordinates of a block of points are formatted together, like in vectors_impl, and the point
+            // element referencing each vertex is written after it. Shards can start between blocks
+            constexpr int block_size = 8;
+            T values[3 * block_size];
+            for (int block_start = begin; block_start < end; block_start += block_size) {
+                int n = end - block_start < block_size ? end - block_start : block_size;
+                for (int i = 0; i < n; i++) {
+                    for (int d = 0; d < 3; d++) {
+                        values[3 * i + d] = positions.at(block_start + i, d);
+                    }
+                    if (chunk.track_bounds) chunk.written_bounds.add(positions, block_start + i);
+                }
+                if (!chunk.welding) chunk.maybe_start_next_shard();
+                chunk.after_element = false;
+                chunk.format_block(values, 3 * n, 3, "\nv", [&](int) {
+                    chunk.v_count += 1;
+                    chunk.point();
+                });
+            }
+        });
+    }
+
+    // Add a vector field glyph for each origin and vector in the given views, e.g., to show gradients or displacements.
+    // Each glyph is an oriented point: a vertex at the origin, a normal holding the vector and a "p v//vn" element
+    // referencing them (see point_vn), so it is smaller than a segment and the viewer draws it with its normal vector
+    // shaders. Commands are written so the viewer shows the point normals with their magnitudes multiplied by `scale`,
+    // or normalized to unit length if `scale` is 0. `vectors` should have the same count as `origins`. Glyphs are not
+    // budgeted
+    template <typename T> BasicObj& vectors3(Strided<T, 3> origins, Strided<T, 3> vectors, float scale = 1) {
+        int count = std::min(origins.count, vectors.count);
+        if (region.kind != Region::NONE) {
+            // Normalized vectors are bounded using their magnitudes, i.e., as if `scale` was 1
+            T tip_scale = static_cast<T>(scale != 0 ? scale : 1);
+            std::vector<int> kept;
+            for (int i = 0; i < count; i++) {
+                Bounds bounds;
+                bounds.add(origins, i);
+                bounds.add(Vec3<T>(
+                    origins.at(i, 0) + vectors.at(i, 0) * tip_scale,
+                    origins.at(i, 1) + vectors.at(i, 1) * tip_scale,
+                    origins.at(i, 2) + vectors.at(i, 2) * tip_scale));
+                if (region.overlaps(bounds)) kept.push_back(i);
+            }
+            std::vector<T> kept_origins, kept_vectors;
+            return without_region([&] {
+                vectors3(origins.gather(kept, kept_origins), vectors.gather(kept, kept_vectors), scale);
+            });
+        }
 
+        vectors_impl("v", &BasicObj::v_count, origins.slice(0, count));
+        vectors_impl("vn", &BasicObj::vn_count, vectors.slice(0, count));
 
-    // Segment rendering
+        // Convert 0-based buffer indices to obj indices by adding these offsets, see :ObjIndexing
+        int v_offset  = negative_indices() ? -count : v_count  - count + 1;
+        int vn_offset = negative_indices() ? -count : vn_count - count + 1;
 
-    // Set visibility of segments i.e., obj file l-directive data
-    Obj& set_segments_visible(bool visible) {
-        return item_command("set_segments_visible").insert((int)visible);
-    }
+        parallel_impl(count, [&](BasicObj& chunk, int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                chunk.p();
+                chunk.obj.append(' ');
+                chunk.format_integer(v_offset + i);
+                chunk.obj.append("//", 2);
+                chunk.format_integer(vn_offset + i);
+            }
+        });
 
-    // Set color of segments i.e., obj file l-directive data
-    Obj& set_segments_color(Color color) {
-        return item_command("set_segments_color").insert(color);
+        set_point_normals_visible(true);
+        set_point_normals_scale(scale != 0 ? scale : 1, scale == 0);
+        return *this;
     }
 
-    // Set width of segments i.e., obj file l-directive data
-    Obj& set_segments_width(float width) {
-        return item_command("set_segments_width").insert(width);
+    // Add `count` vector field glyphs with origins given by `XYZs` and vectors given by `UVWs`, see vectors3
+    template <typename T> BasicObj& vectors3(int count, const T* XYZs, const T* UVWs, float scale = 1) {
+        return vectors3(strided<3>(XYZs, count), strided<3>(UVWs, count), scale);
     }
 
 
-    // Edges rendering. Applies to triangle edges, but not segment elements.
+    //
+    // Segment Elements.  Indices are 1-based, see :ObjIndexing
+    //
 
-    // Set visibility of triangle edges i.e., obj file f-directive data
-    Obj& set_edges_visible(bool visible) {
-        return item_command("set_edges_visible").insert((int)visible);
+    // Add a segment element connecting vertices vi and vj
+    BasicObj& segment(int vi = -2, int vj = -1) {
+        return l().insert(v_index(vi)).insert(v_index(vj));
     }
 
-    // Set color of triangle edges i.e., obj file f-directive data
-    Obj& set_edges_color(Color color) {
-        return item_command("set_edges_color").insert(color);
+    // Add an oriented segment element referencing the 2 previous vertex positions and normals (default).
+    // The user can provide explicit indicies to reference vertices vi/ vj and normals ni/nj
+    BasicObj& segment_vn(int vi = -2, int vj = -1, int ni = -2, int nj = -1) {
+        l();
+        insert(v_index(vi)).add("//").add(vn_index(ni));
+        insert(v_index(vj)).add("//").add(vn_index(nj));
+        return *this;
     }
 
-    // Set width of triangle edges i.e., obj file f-directive data
-    Obj& set_edges_width(float width) {
-        return item_command("set_edges_width").insert(width);
+    // Add 2 vertex positions and a segment element referencing them
+    template <typename T> BasicObj& segment2(Vec2<T> a, Vec2<T> b) {
+        if (!admit(a, b)) return *this;
+        if (welding) return weld(a).weld(b).welded_element('l');
+        return vertex2(a).vertex2(b).segment();
     }
 
-
-    // Triangle rendering
-
-    // Set visibility of triangles i.e., obj file f-directive data
-    Obj& set_triangles_visible(bool visible) {
-        return item_command("set_triangles_visible").insert((int)visible);
+    // Add 2 vertex positions with the given color and a segment element referencing them
+    template <typename T> BasicObj& segment2(Vec2<T> a, Vec2<T> b, Color c) {
+        if (!admit(a, b)) return *this;
+        if (welding) return weld(a, &c).weld(b, &c).welded_element('l');
+        return vertex2(a, c).vertex2(b, c).segment();
     }
 
-    // Set color of triangles i.e., obj file f-directive data
-    Obj& set_triangles_color(Color color) {
-        return item_command("set_triangles_color").insert(color);
+    // Add 2 vertex positions and a segment element referencing them
+    template <typename T> BasicObj& segment3(Vec3<T> a, Vec3<T> b) {
+        if (!admit(a, b)) return *this;
+        if (welding) return weld(a).weld(b).welded_element('l');
+        return vertex3(a).vertex3(b).segment();
     }
 
+    // Add 2 vertex positions with the given color and a segment element referencing them
+    template <typename T> BasicObj& segment3(Vec3<T> a, Vec3<T> b, Color c) {
+        if (!admit(a, b)) return *this;
+        if (welding) return weld(a, &c).weld(b, &c).welded_element('l');
+        return vertex3(a, c).vertex3(b, c).segment();
+    }
 
+    // Add 2 vertex positions, 2 vertex normals and an oriented segment element referencing them
+    template <typename T> BasicObj& segment3_vn(Vec3<T> va, Vec3<T> vb, Vec3<T> na, Vec3<T> nb) {
+        if (!admit(va, vb)) return *this;
+        if (welding) return weld(va).weld_normal(na).weld(vb).weld_normal(nb).welded_element('l');
+        return vertex3(va).normal3(na).vertex3(vb).normal3(nb).segment_vn();
+    }
 
-
-
-    //
-    // Implementation methods
-    //
-
-    // Writes a polyline or a triangle fan
-    template <typename T> Obj& poly_impl(char directive, int point_count, T* coords, uint8_t point_dimension, bool repeat_last = false) {
-        min_count == 'f' ? 3 : 2;
-        if (point_count < min_count) {
-            return *this;
+    // Add the vertex positions in the given view and a segment element for each consecutive pair of them i.e., the
+    // i-th segment connects positions 2i and 2i+1. If `colors` is not empty it should have the same count as `positions`
+    template <typename T, typename C = uint8_t> BasicObj& segments3(Strided<T, 3> positions, Strided<C, 3> colors = {}) {
+        if (region.kind != Region::NONE) {
+            std::vector<int> kept; // Indices of the endpoints of the kept segments
+            for (int i = 0; i + 1 < positions.count; i += 2) {
+                Bounds bounds;
+                bounds.add(positions, i);
+                bounds.add(positions, i + 1);
+                if (region.overlaps(bounds)) {
+                    kept.push_back(i);
+                    kept.push_back(i + 1);
+                }
+            }
+            std::vector<T> kept_positions;
+            std::vector<C> kept_colors;
+            return without_region([&] {
+                segments3(positions.gather(kept, kept_positions), colors.gather(kept, kept_colors));
+            });
         }
 
-        for (int i = 0; i < point_count; i++) {
-            v();
-            for (int d = 0; d < point_dimension; d++) {
-                insert<T>(*(coords + i * point_dimension + d));
+        return parallel_impl(positions.count / 2, [&](BasicObj& chunk, int begin, int end) {
+            chunk.v_count += 2 * begin;
+            for (int i = 2 * begin; i < 2 * end; i += 2) {
+                chunk.v().position_at(positions, i);
+                if (colors) chunk.color_at(colors, i);
+                chunk.v().position_at(positions, i + 1);
+                if (colors) chunk.color_at(colors, i + 1);
+                chunk.segment();
             }
-        }
+        });
+    }
 
-        directive == 'f' ? f() : l();
-        for (int i = -point_count; i < 0; i++) {
-            insert(v_index(i));
-        }
 
-        if (repeat_last) insert(v_index(-point_count));
+    //
+    // Triangle Elements.  Indices are 1-based, see :ObjIndexing
+    //
 
-        // No newline so the caller can add an annotation
+    // Add a triangle element referencing the 3 previous vertex positions (default).
+    // The user can provide explicit indicies to reference vertices vi, vj and vk
+    BasicObj& triangle(int vi = -3, int vj = -2, int vk = -1) {
+        f();
+        insert(v_index(vi));
+        insert(v_index(vj));
+        insert(v_index(vk));
+        return *this;
+    }
 
+    // Add a triangle element referencing the 3 previous vertex positions and normals (default).
+    // The user can provide explicit indicies to reference vertices vi, vj and vk; and normals ni, nj and nk
+    BasicObj& triangle_vn(
+        int vi = -3, int vj = -2, int vk = -1, // vertex v-directive  references
+        int ni = -3, int nj = -2, int nk = -1  // normal vn-directive references
+    ) {
+        f();
+        insert(v_index(vi)).add("//").add(vn_index(ni));
+        insert(v_index(vj)).add("//").add(vn_index(nj));
+        insert(v_index(vk)).add("//").add(vn_index(nk));
         return *this;
     }
 
-    // Write 2D vertex positions as a variadic call
-    template <typename T> Obj& vertex2_variadic(int point_count, Vec2<T> p1, Vec2<T> p2, Vec2<T> p3, va_list va) {
-        vertex2(p1).vertex2(p2).vertex2(p3);
-        for (int i = 0; i < point_count-3; i++) {
-            Vec2<T> pn = va_arg(va, Vec2<T>);
-            vertex2(pn);
-        }
-        // No newline so the caller can add an annotation
+    // Add a triangle element referencing the 3 previous vertex positions and texture vertices (default).
+    // The user can provide explicit indices to reference vertices vi, vj and vk; and texture vertices ti, tj and tk
+    BasicObj& triangle_vt(
+        int vi = -3, int vj = -2, int vk = -1, // vertex  v-directive  references
+        int ti = -3, int tj = -2, int tk = -1  // texture vt-directive references
+    ) {
+        f();
+        insert(v_index(vi)).add("/").add(vt_index(ti));
+        insert(v_index(vj)).add("/").add(vt_index(tj));
+        insert(v_index(vk)).add("/").add(vt_index(tk));
         return *this;
     }
 
-    // Write 3D vertex positions as a variadic call
-    template <typename T> Obj& vertex3_variadic(int point_count, Vec3<T> p1, Vec3<T> p2, Vec3<T> p3, va_list va) {
-        vertex3(p1).vertex3(p2).vertex3(p3);
-        for (int i = 0; i < point_count-3; i++) {
-            Vec3<T> pn = va_arg(va, Vec3<T>);
-            vertex3(pn);
-        }
-        // No newline so the caller can add an annotation
+    // Add a triangle element referencing the 3 previous vertex positions, vertex normals and texture vertices (default).
+    // The user can provide explicit indices reference vertices vi, vj and vk; normals ni, nj and nk; and texture vertices ti, tj and tk
+    BasicObj& triangle_vnt(
+        int vi = -3, int vj = -2, int vk = -1, // vertex  v-directive  references
+        int ni = -3, int nj = -2, int nk = -1, // normal  vn-directive references
+        int ti = -3, int tj = -2, int tk = -1  // texture vt-directive references
+    ) {
+        f();
+        insert(v_index(vi)).add("/").add(vt_index(ti)).add("/").add(vn_index(ni));
+        insert(v_index(vj)).add("/").add(vt_index(tj)).add("/").add(vn_index(nj));
+        insert(v_index(vk)).add("/").add(vt_index(tk)).add("/").add(vn_index(nk));
         return *this;
     }
 
-    // Return the v-directive index to use
-    int v_index(int i) {
-        // @TODO Could ensure i and v_count are consistent here to catch errors! Prizm does a good job of catching errors anyway so maybe this is not needed---but need to confirm Prizm catches this particular error
-        return (i > 0 || use_negative_indices) ? i : v_count + 1 + i;
+    // Add 3 vertex positions and a triangle element referencing them
+    template <typename T> BasicObj& triangle2(Vec2<T> va, Vec2<T> vb, Vec2<T> vc) {
+        if (!admit(va, vb, vc)) return *this;
+        if (welding) return weld(va).weld(vb).weld(vc).welded_element('f');
+        return vertex2(va).vertex2(vb).vertex2(vc).triangle();
     }
 
-    // Return the vn-directive index to use
-    int vn_index(int i) {
-        return (i > 0 || use_negative_indices) ? i : vn_count + 1 + i;
+    // Add 3 vertex positions with the given color and a triangle element referencing them
+    template <typename T> BasicObj& triangle2(Vec2<T> va, Vec2<T> vb, Vec2<T> vc, Color c) {
+        if (!admit(va, vb, vc)) return *this;
+        if (welding) return weld(va, &c).weld(vb, &c).weld(vc, &c).welded_element('f');
+        return vertex2(va, c).vertex2(vb, c).vertex2(vc, c).triangle();
     }
 
-    // Return the vt-directive index to use
-    int vt_index(int i) {
-        return (i > 0 || use_negative_indices) ? i : vt_count + 1 + i;
+    // Add 3 vertex positions and a triangle element referencing them
+    template <typename T> BasicObj& triangle3(Vec3<T> va, Vec3<T> vb, Vec3<T> vc) {
+        if (!admit(va, vb, vc)) return *this;
+        if (welding) return weld(va).weld(vb).weld(vc).welded_element('f');
+        return vertex3(va).vertex3(vb).vertex3(vc).triangle();
     }
 
+    // Add 3 vertex positions with the given color and a triangle element referencing them
+    template <typename T> BasicObj& triangle3(Vec3<T> va, Vec3<T> vb, Vec3<T> vc, Color c) {
+        if (!admit(va, vb, vc)) return *this;
+        if (welding) return weld(va, &c).weld(vb, &c).weld(vc, &c).welded_element('f');
+        return vertex3(va, c).vertex3(vb, c).vertex3(vc, c).triangle();
+    }
 
+    // Add 3 vertex positions, 3 vertex normals and a triangle element referencing them
+    template <typename T> BasicObj& triangle3_vn(
+        Vec3<T> va, Vec3<T> vb, Vec3<T> vc,
+        Vec3<T> na, Vec3<T> nb, Vec3<T> nc
+    ) {
+        if (!admit(va, vb, vc)) return *this;
+        if (welding) return weld(va).weld_normal(na).weld(vb).weld_normal(nb).weld(vc).weld_normal(nc).welded_element('f');
+        return vertex3(va).normal3(na).vertex3(vb).normal3(nb).vertex3(vc).normal3(nc).triangle_vn();
+    }
 
+    // Add 3 vertex positions, 3 uvs and a triangle element referencing them
+    template <typename T> BasicObj& triangle3_vt(
+        Vec3<T> va, Vec3<T> vb, Vec3<T> vc,
+        Vec2<T> ta, Vec2<T> tb, Vec2<T> tc
+    ) {
+        if (!admit(va, vb, vc)) return *this;
+        return vertex3(va).uv2(ta).vertex3(vb).uv2(tb).vertex3(vc).uv2(tc).triangle_vt();
+    }
 
-    //
-    // User-provided extension methods
-    //
+    // Add 3 vertex positions, 3 texture vertices and a triangle element referencing them
+    // @TODO This seems not very useful, perhaps just remove it
+    template <typename T> BasicObj& triangle3_vt(
+        Vec3<T> va, Vec3<T> vb, Vec3<T> vc,
+        Vec3<T> ta, Vec3<T> tb, Vec3<T> tc
+    ) {
+        if (!admit(va, vb, vc)) return *this;
+        return vertex3(va).tangent3(ta).vertex3(vb).tangent3(tb).vertex3(vc).tangent3(tc).triangle_vt();
+    }
 
-#ifdef PRIZM_OBJ_CLASS_EXTRA
-    PRIZM_OBJ_CLASS_EXTRA
-#endif
-};
+    // Add 3 vertex positions, 3 vertex normals, 3 texture vertices and a triangle element referencing them
+    template <typename T> BasicObj& triangle3_vnt(
+        Vec3<T> va, Vec3<T> vb, Vec3<T> vc,
+        Vec3<T> na, Vec3<T> nb, Vec3<T> nc,
+        Vec3<T> ta, Vec3<T> tb, Vec3<T> tc
+    ) {
+        if (!admit(va, vb, vc)) return *this;
+        return vertex3(va).normal3(na).tangent3(ta).vertex3(vb).normal3(nb).tangent3(tb).vertex3(vc).normal3(nc).tangent3(tc).triangle_vnt();
+    }
 
 
-bool documentation(bool write_files) {
 
-    // This `documentation` function is also used a test, hence this function
-    bool tests_pass = true;
-    auto test = [&write_files](std::string filename, std::string got, std::string wanted) {
-        bool passed = true;
-        if (wanted == got) {
-            std::cout << "Test  " << filename << " PASSED..." << std::endl;
-        } else {
-            std::cout << "Test  " << filename << " FAILED..." << std::endl;
-            std::cout << "Wanted:" << wanted << "\nGot:" << got << std::endl;
-            passed = false;
+
+    //
+    // Triangle Meshes. These are written from vertex/index buffers so, unlike triangle3, connectivity is preserved
+    //
+
+    // Add `vertex_count` vertex positions, described by the given 3D coordinate buffer, and `triangle_count` triangle
+    // elements described by the IJKs buffer, which contains 0-based indices into the vertex buffer. Each vertex is
+    // written once. If non-null the per-vertex normals (3 coordinates per vertex), UVs (2 coordinates per vertex) and
+    // colors are also written and referenced by the triangle elements
+    template <typename T, typename Index> BasicObj& mesh3(
+        int vertex_count, const T* XYZs,
+        int triangle_count, const Index* IJKs,
+        const T* NXYZs = nullptr, const T* UVs = nullptr, const Color* colors = nullptr
+    ) {
+        return mesh3(
+            strided<3>(XYZs, vertex_count),
+            triangle_count, IJKs,
+            strided<3>(NXYZs, vertex_count),
+            strided<2>(UVs, vertex_count),
+            strided<3>(colors ? &colors->r : nullptr, vertex_count, sizeof(Color)));
+    }
+
+    // Add a triangle mesh with vertex data given by views, see Strided. The optional `normals`, `uvs` and `colors` views
+    // should be empty or have the same count as `positions`
+    template <typename T, typename Index, typename C = uint8_t> BasicObj& mesh3(
+        Strided<T, 3> positions,
+        int triangle_count, const Index* IJKs,
+        Strided<T, 3> normals = {}, Strided<T, 2> uvs = {}, Strided<C, 3> colors = {}
+    ) {
+        int vertex_count = positions.count;
+        if (vertex_count < 1) return *this;
+
+        if (region.kind != Region::NONE) {
+            // Keep the triangles overlapping the region and compact the vertices they reference, so vertices which are
+            // only used by dropped triangles are not written
+            std::vector<int> compact(vertex_count, -1); // Maps vertex indices to compact indices
+            std::vector<int> kept; // Maps compact indices to vertex indices
+            std::vector<int> kept_IJKs;
+            for (int t = 0; t < triangle_count; t++) {
+                Bounds bounds;
+                for (int c = 0; c < 3; c++) bounds.add(positions, static_cast<int>(IJKs[3*t + c]));
+                if (!region.overlaps(bounds)) continue;
+                for (int c = 0; c < 3; c++) {
+                    int i = static_cast<int>(IJKs[3*t + c]);
+                    if (compact[i] < 0) {
+                        compact[i] = static_cast<int>(kept.size());
+                        kept.push_back(i);
+                    }
+                    kept_IJKs.push_back(compact[i]);
+                }
+            }
+            std::vector<T> kept_positions, kept_normals, kept_uvs;
+            std::vector<C> kept_colors;
+            return without_region([&] {
+                mesh3(positions.gather(kept, kept_positions),
+                      static_cast<int>(kept_IJKs.size() / 3), kept_IJKs.data(),
+                      normals.gather(kept, kept_normals),
+                      uvs.gather(kept, kept_uvs),
+                      colors.gather(kept, kept_colors));
+            });
         }
-        if (!passed || write_files) {
-            std::ofstream file;
-            file.open(filename, std::ofstream::out | std::ofstream::trunc);
-            file << got;
-            file.close();
-            std::cout << "Wrote " << filename << std::endl;
+
+        if (colors) {
+            parallel_impl(vertex_count, [&](BasicObj& chunk, int begin, int end) {
+                chunk.v_count += begin;
+                for (int i = begin; i < end; i++) chunk.v().position_at(positions, i).color_at(colors, i);
+            });
+        } else {
+            vectors_impl("v", &BasicObj::v_count, positions);
         }
-        return passed;
-    };
+        vectors_impl("vn", &BasicObj::vn_count, normals);
+        vectors_impl("vt", &BasicObj::vt_count, uvs);
+
+        // Convert 0-based buffer indices to obj indices by adding these offsets, see :ObjIndexing
+        int v_offset  = negative_indices() ? -vertex_count : v_count  - vertex_count + 1;
+        int vn_offset = negative_indices() ? -vertex_count : vn_count - vertex_count + 1;
+        int vt_offset = negative_indices() ? -vertex_count : vt_count - vertex_count + 1;
+
+        parallel_impl(triangle_count, [&](BasicObj& chunk, int begin, int end) {
+            for (int t = begin; t < end; t++) {
+                chunk.f();
+                for (int c = 0; c < 3; c++) {
+                    int i = static_cast<int>(IJKs[3*t + c]);
+                    chunk.obj.append(' ');
+                    chunk.format_integer(v_offset + i);
+                    if (uvs) {
+                        chunk.obj.append('/');
+                        chunk.format_integer(vt_offset + i);
+                    }
+                    if (normals) {
+                        chunk.obj.append(uvs ? "/" : "//", uvs ? 1 : 2);
+                        chunk.format_integer(vn_offset + i);
+                    }
+                }
+            }
+        });
 
+        // No newline so the caller can add an annotation to the last triangle
+        return *this;
+    }
 
 
 
-    // This block illustrates most of the API
-    {
-        // Access Obj struct and typedefs. This isn't strictly necessary here but its likely you'll want it in user code
-        using namespace Prizm;
 
-        Obj obj;
 
-        // First we'll add a comment at the top of the file. If you look at the `output` string below you can see that
-        // the provided text is prefixed by ## in the obj file, the obj spec uses a # to start a comment.
-        obj.comment("This file tests the Prizm C++ API");
+    //
+    // Polylines. These are sequences of segment elements
+    //
 
-        // Now we'll write 3 vertices and a triangle element in a very verbose way. Note that most functions in the
-        // `Obj` API return `Obj&` which allows you to chain calls which can be handy if you like your debugging code
-        // to be concise
-        obj.vertex3(V3{0., 0., 1.}).annotation("Vertex A");
-        obj.vertex3(V3{3., 0., 1.}).annotation("Vertex B");
-        obj.vertex3(V3{3., 3., 1.}).annotation("Vertex C");
-        obj.triangle().annotation("Triangle ABC");
+    // Add a polyline element referencing the previous N vertex positions
+    // N should be at least 2
+    BasicObj& polyline(int N, bool closed = false) {
+        if (N < 2) return *this;
+        l(); // Start the element
+        for (int i = -N; i < 0; i++) insert(v_index(i)); // Continue the element
+        if (closed) insert(v_index(-N)); // Close the polyline
+        return *this;
+    }
 
-        // The previous block had a lot of typing... you can do something similar (without the vertex annotations) as a
-        // one-liner like this:
-        obj.triangle3(V3{0., 0., 2.}, V3{3., 0., 2.}, V3{3., 3., 2.}).annotation("Triangle ABC");
+    // Add an oriented polyline element referencing the previous N vertex positions and normals
+    // N should be at least 2
+    BasicObj& polyline_vn(int N, bool closed = false) {
+        if (N < 2) return *this;
+        l(); // Start the element
+        for (int i = -N; i < 0; i++) insert(v_index(i)).add("//").add(vn_index(i)); // Continue the element
+        if (closed) insert(v_index(-N)).add("//").add(vn_index(-N)); // Close the polyline
+        return *this;
+    }
 
-        // The triangle element and vertex positions we just added to the obj all have _Annotation_ strings associated
-        // with them. These strings can be visualized in Prizm by turning on annotation labelling.  The annotations are
-        // written to the obj file using obj comment syntax which means that adding them doesn't prevent the geometry
-        // loading in a different obj viewer (but, of course, in a different viewer you won't be able to see the
-        // annotations). Note we need to use the verbose version we want to annotate the vertices.
+    // Add a polyline element referencing the vertices with the given indicies
+    BasicObj& polyline(int N, int i, int j, ...) {
+        segment(i, j); // Start the element
+        va_list va;
+        va_start(va, j);
+        for (int n = 0; n < N-2; n++) insert(va_arg(va, int)); // Continue the element
+        va_end(va);
+        return *this;
+    }
 
-        // The Obj class will have a bunch of functions for writing compound shapes for now polylines, polygons and
-        // boxes are supported but more will be added. To demo these functions we'll use the following data which
-        // represents a 2D star shape; we use a union so we can illustrate different APIs.
-        union {
-            double coords[8*2] = {
-                2, 2,   10, 0,   2, -2,   0, -10,   -2, -2,   -10, 0,   -2, 2,   0, 10
-            };
-            struct {
-                V2 a, b, c, d, e, f, g, h;
-            } points;
-        } star;
+    // Add N vertex positions, described by the given 2D coordinate buffer, and a polyline element referencing them.
+    // N should be at least 2. If closed is true write the first point index again to close the polyline
+    template <typename T> BasicObj& polyline2(int N, T* XYs, bool closed = false) {
+        return poly_impl('l', strided<2>(XYs, N), closed);
+    }
 
-        // First we'll write the star as a polyline boundary using a pointer-to-coordinate-buffer API:
-        obj.polyline2(8, star.coords, true).annotation("star boundary");
+    // Add N vertex positions, described by the given 3D coordinate buffer, and a polyline element referencing them.
+    // N should be at least 2. If closed is true write the first point index again to close the polyline
+    template <typename T> BasicObj& polyline3(int N, T* XYZs, bool closed = false) {
+        return poly_impl('l', strided<3>(XYZs, N), closed);
+    }
 
-        // Next, we'll write the star as a polygon using a variadic function call, a similar variadic function also
-        // exists for writing polyline2 geometry
-        obj.polygon2(8,
-            star.points.a,
-            star.points.b,
-            star.points.c,
-            star.points.d,
-            star.points.e,
-            star.points.f,
-            star.points.g,
-            star.points.h).annotation("star polygon");
+    // Add the 2D vertex positions in the given view and a polyline element referencing them, see polyline2
+    template <typename T> BasicObj& polyline2(Strided<T, 2> points, bool closed = false) {
+        return poly_impl('l', points, closed);
+    }
 
-        // The previous line wrote the coordinate data again even though we wrote it when we called polyline2, this
-        // is probably fine for debugging code but, just to illustrate another function, we can write only an obj
-        // f-directive references the previous vertices as follows:
-        obj.polygon(8).annotation("star polygon again");
+    // Add the 3D vertex positions in the given view and a polyline element referencing them, see polyline3
+    template <typename T> BasicObj& polyline3(Strided<T, 3> points, bool closed = false) {
+        return poly_impl('l', points, closed);
+    }
 
-        // Note the obj spec allows you to reference previous vertices by using negative indices.  This feature is
-        // pretty handy for not having to track the current vertex index and also for enabling you to concatenate obj
-        // files into a single jumbo file, which we'll illustrate later.  One downside of using this feature is that
-        // it appears not to be well supported by other viewers so in a future update of this API we'll add a function
-        // to convert files into some well-supported subset of the spec e.g., by converting negative indices into
-        // positive ones and converting l-/f-directives with more than 2/3 indices on a single line into a list of
-        // l-/f-directives with exactly 2/3 indices on each line.
+    // Add the given 2D vertex positions and a polyline element referencing them
+    // @TODO Test if this can this be called with only two points
+    template <typename T> BasicObj& polyline2(int N, Vec2<T> p1, Vec2<T> p2, Vec2<T> p3, ...) {
+        va_list va;
+        va_start(va, p3);
+        bool admitted = admit_variadic(N, p1, p2, p3, va);
+        if (admitted) vertex2_variadic(N, p1, p2, p3, va);
+        va_end(va);
+        if (!admitted) return *this;
+        if (welding) return welded_element('l');
+        return polyline(N);
+    }
 
-        // In general functions ending with a number have 2D/3D vector arguments and write both v-directives and the
-        // relevant element directives. If you want to just write the element directive you can use the functions with
-        // no number postfix. Note for some functions the number indicating dimension is redundant but we write it
-        // anyway for consistency.
+    // Add the given 3D vertex positions and a polyline element referencing them
+    // @TODO Test if this can this be called with only two points
+    template <typename T> BasicObj& polyline3(int N, Vec3<T> p1, Vec3<T> p2, Vec3<T> p3, ...) {
+        va_list va;
+        va_start(va, p3);
+        bool admitted = admit_variadic(N, p1, p2, p3, va);
+        if (admitted) vertex3_variadic(N, p1, p2, p3, va);
+        va_end(va);
+        if (!admitted) return *this;
+        if (welding) return welded_element('l');
+        return polyline(N);
+    }
 
-        // Here we write a bounding box for the star we just logged:
-        constexpr double inf = std::numeric_limits<double>::infinity();
-        V2 star_min{inf, inf}, star_max{-inf, -inf};
-        for (int i = 0; i < 8; i++) {
-            double x = star.coords[2*i + 0], y = star.coords[2*i + 1];
-            star_max.x = std::max(star_max.x , x);
-            star_min.x = std::min(star_min.x , x);
-            star_max.y = std::max(star_max.y , y);
-            star_min.y = std::min(star_min.y , y);
-        }
-        obj.box2_min_max(star_min, star_max).annotation("star bounding box");
 
-        // So far we've only had one annotation per geometric entity (vertex/element), this is because Prizm
-        // represents annotations with a single string and there are no plans to change this. If you call the
-        // annotation function more than once per line each call concatenates into a single annotation string
-        obj.point2(V2{4., 7.}).annotation("these").annotation("are").annotation("concatenated");
 
-        // In some cases it can be useful attach more one or pieces of typed numerical data to the each geometric
-        // entity of a mesh e.g., a scalar cost of a triangle edge collapse or a vertex displacement in a finite
-        // element mesh.  A future version of Prizm will support this by adding _Attributes_ to its internal mesh
-        // datastructure along with UI for inspecting and rendering them.  The current plan for attributes is that
-        // they will be set by parsing and extracting data stored in the annotation strings.  This extraction step
-        // will require users to execute a console command explicity or by adding a _Command Annotation_ to the
-        // obj file (command annotations are explained later but they are essentially console commands executed by
-        // the obj file).  In order to facilitate this parsing Prizm will assume attributes are prefixed by an @
-        // and as part of the attribute extraction the relevant portion of the annotation string will be trimmed.
-        // After extraction, the data structure you can inspect in Prizm will have typed attributes as well as
-        // annotations corresponding to the part of the raw in-file annotation strings before the first @.
-        //
-        // Although there is no special rendering/UI for attributes yet (you can only view attributes as the raw
-        // annotation strings) you might still prefer to call the attribute function when adding multiple pieces
-        // of data to a geometric entity because the @'s make the separate data more distinguishable. Here is an
-        // example of point with an annotation and two attributes of different types. Note the attribute function
-        // supports any type which defines an operator<<. Actually, the annotation function in this API also
-        // supports writing non-string data using operator<< but this is just for convenience; rendering/UI support
-        // for annotations in Prizm is built around the assumption that they contain only string data).
-        obj.point2(V2{3., 3.}).annotation("some string").attribute(42).attribute(V2{0.,0.});
 
-        // Add some blank space to clearly separate obj geometry from the command annotations to come.
-        obj.newline(3);
 
-        // Next we'll demonstrate how you can configure how Prizm displays the obj file when it is loaded by writing
-        // command annotations to the obj file.
-        obj.comment("Command Annotations:");
+    //
+    // Convex Polygons. These are sequences of triangle elements aka triangle fans
+    //
 
-        // Configuring how Prizm displays the obj file is handy because, depending on your debugging use-case, you
-        // will want to see different things.  You could configure the display settings you want by clicking around
-        // in the UI, or by calling the relevant console commands after the file is loaded but this can be slow or
-        // annoying so to save you having to do this manually Prizm's command annotation facility enables you to
-        // execute console commands immediately after the file is loaded.
-        //
-        // For the obj we have been creating so far we are probably only interested in seeing the annotations we added,
-        // so in practice we would probably only want to call the following functions...
-        obj.set_annotations_visible(true);
-        obj.set_annotations_scale(1.);
-        obj.set_annotations_color(BLUE);
+    // Add a polygon element referencing the previous N vertices.
+    // N should be at least 3
+    BasicObj& polygon(int N) {
+        if (N < 3) return *this;
+        f(); // Start the element
+        for (int i = -N; i < 0; i++) insert(v_index(i)); // Continue the element
+        return *this;
+    }
 
-        // ...but since we are using this documentation for testing as well we'll just call all the config functions
-        // to verify they are executed with no errors.  First we'll set the precision of the floats we write to the obj
-        // file so that the `output` string looks a bit nicer.
-        obj.set_precision(2);
-        obj.set_vertex_index_labels_visible(false);
+    // Add a polygon element referencing the vertices with the given indices.
+    BasicObj& polygon(int N, int i, int j, int k, ...) {
+        triangle(i, j, k); // Start the element
+        va_list va;
+        va_start(va, k);
+        for (int n = 0; n < N-3; n++) insert(va_arg(va, int)); // Continue the element
+        va_end(va);
+        return *this;
+    }
+
+    // Add N vertex positions, described by the given 2D coordinate buffer, and a polygon element referencing them
+    // N should be at least 3
+    template <typename T> BasicObj& polygon2(int N, T* XYs) {
+        return poly_impl('f', strided<2>(XYs, N));
+    }
+
+    // Add N vertex positions, described by the given 3D coordinate buffer, and a polygon element referencing them
+    // N should be at least 3
+    template <typename T> BasicObj& polygon3(int N, T* XYZs) {
+        return poly_impl('f', strided<3>(XYZs, N));
+    }
+
+    // Add the 2D vertex positions in the given view and a polygon element referencing them, see polygon2
+    template <typename T> BasicObj& polygon2(Strided<T, 2> points) {
+        return poly_impl('f', points);
+    }
+
+    // Add the 3D vertex positions in the given view and a polygon element referencing them, see polygon3
+    template <typename T> BasicObj& polygon3(Strided<T, 3> points) {
+        return poly_impl('f', points);
+    }
+
+    // Add the given 2D vertex positions and a polygon element referencing them
+    template <typename T> BasicObj& polygon2(int N, Vec2<T> p1, Vec2<T> p2, Vec2<T> p3, ...) {
+        va_list va;
+        va_start(va, p3);
+        bool admitted = admit_variadic(N, p1, p2, p3, va);
+        if (admitted) vertex2_variadic(N, p1, p2, p3, va);
+        va_end(va);
+        if (!admitted) return *this;
+        if (welding) return welded_element('f');
+        return polygon(N);
+    }
+
+    // Add the given 3D vertex positions and a polygon element referencing them
+    template <typename T> BasicObj& polygon3(int N, Vec3<T> p1, Vec3<T> p2, Vec3<T> p3, ...) {
+        va_list va;
+        va_start(va, p3);
+        bool admitted = admit_variadic(N, p1, p2, p3, va);
+        if (admitted) vertex3_variadic(N, p1, p2, p3, va);
+        va_end(va);
+        if (!admitted) return *this;
+        if (welding) return welded_element('f');
+        return polygon(N);
+    }
+
+
+
+
+
+    //
+    // Axis-aligned Boxes.
+    //
+
+    // Add a 2D box region defined by min/max, visualized with segment elements
+    template <typename T> BasicObj& box2_min_max(Vec2<T> min, Vec2<T> max) {
+        T coords[5*2] = {min.x, min.y,  max.x, min.y,  max.x, max.y,  min.x, max.y,  min.x, min.y};
+        return polyline2(5, coords);
+    }
+
+    // Add a 3D box region defined by min/max, visualized with segment elements
+    template <typename T> BasicObj& box3_min_max(Vec3<T> min, Vec3<T> max) {
+        // This has some redundant edges but having them means we could annotate all segments in the shape conveniently
+        // Visit order: p000, p100, p110, p010, p000, p001, p101, p100, p101, p111, p110, p111, p011, p010, p011, p001
+        T coords[16*3] = {
+            min.x, min.y, min.z,  max.x, min.y, min.z,  max.x, max.y, min.z,  min.x, max.y, min.z,
+            min.x, min.y, min.z,  min.x, min.y, max.z,  max.x, min.y, max.z,  max.x, min.y, min.z,
+            max.x, min.y, max.z,  max.x, max.y, max.z,  max.x, max.y, min.z,  max.x, max.y, max.z,
+            min.x, max.y, max.z,  min.x, max.y, min.z,  min.x, max.y, max.z,  min.x, min.y, max.z};
+        return polyline3(16, coords);
+    }
+
+    // Add a 2D box region defined by a center point and extents vector (box side lengths), visualized with segment elements
+    template <typename T> BasicObj& box2_center_extents(Vec2<T> center, Vec2<T> extents) {
+        return box2_min_max<T>(
+            {center.x - extents.x/2, center.y - extents.y/2},
+            {center.x + extents.x/2, center.y + extents.y/2});
+    }
+
+    // Add a 3D box region defined by a center point and extents vector (box side lengths), visualized with segment elements
+    template <typename T> BasicObj& box3_center_extents(Vec3<T> center, Vec3<T> extents) {
+        return box3_min_max<T>(
+            {center.x - extents.x/2, center.y - extents.y/2, center.z - extents.z/2},
+            {center.x + extents.x/2, center.y + extents.y/2, center.z + extents.z/2});
+    }
+
+    // Add a 3D box for each min/max pair in the given views, e.g., the nodes of a bounding volume hierarchy or an octree.
+    // Each box writes its 8 corner vertices once and its 12 edges as segment elements, so it is much smaller and faster
+    // to write than box3_min_max, which repeats corners and edges. If `depths` is not empty the segments of each box get
+    // a "@depth" attribute (e.g., the level of the node in the tree) which the viewer can filter boxes by, and if
+    // `colors` is not empty each box gets the color with the same index, see color_at. Both views should be empty or
+    // have the same count as `mins`. Boxes are not budgeted
+    template <typename T, typename Depth = int, typename C = uint8_t> BasicObj& boxes3(
+        Strided<T, 3> mins, Strided<T, 3> maxs, Strided<Depth, 1> depths = {}, Strided<C, 3> colors = {}
+    ) {
+        int count = std::min(mins.count, maxs.count);
+        if (region.kind != Region::NONE) {
+            std::vector<int> kept;
+            for (int b = 0; b < count; b++) {
+                Bounds bounds;
+                bounds.add(mins, b);
+                bounds.add(maxs, b);
+                if (region.overlaps(bounds)) kept.push_back(b);
+            }
+            std::vector<T> kept_mins, kept_maxs;
+            std::vector<Depth> kept_depths;
+            std::vector<C> kept_colors;
+            return without_region([&] {
+                boxes3(mins.gather(kept, kept_mins), maxs.gather(kept, kept_maxs),
+                       depths.gather(kept, kept_depths), colors.gather(kept, kept_colors));
+            });
+        }
+
+        // Corner c of a box is at the max coordinate along x if bit 0 of c is set, along y if bit 1 is set and along z if
+        // bit 2 is set. The polyline visits 9 edges and the remaining 3 edges are separate segments
+        constexpr int corner_count = 8;
+        static constexpr int polyline[10] = {0, 1, 3, 2, 0, 4, 5, 7, 6, 4};
+        static constexpr int segments[3][2] = {{1, 5}, {2, 6}, {3, 7}};
+
+        return parallel_impl(count, [&](BasicObj& chunk, int begin, int end) {
+            chunk.v_count += begin * corner_count;
+
+            T xyzs[3 * corner_count] = {};
+            Strided<T, 3> corners = strided<3>(xyzs, corner_count);
+            for (int b = begin; b < end; b++) {
+                for (int c = 0; c < corner_count; c++) {
+                    for (int d = 0; d < 3; d++) {
+                        xyzs[3*c + d] = (c >> d) & 1 ? maxs.at(b, d) : mins.at(b, d);
+                    }
+                }
+
+                chunk.maybe_start_next_shard(); // Shards can only split files between boxes
+                chunk.after_element = false;
+                if (colors || chunk.quantization.enabled) {
+                    for (int c = 0; c < corner_count; c++) {
+                        chunk.v().position_at(corners, c);
+                        if (colors) chunk.color_at(colors, b);
+                    }
+                } else {
+                    if (chunk.track_bounds) {
+                        chunk.written_bounds.add(mins, b);
+                        chunk.written_bounds.add(maxs, b);
+                    }
+                    chunk.format_block(xyzs, 3 * corner_count, 3, "\nv");
+                    chunk.v_count += corner_count;
+                }
+                chunk.hash_count = 0;
+
+                // Convert corner indices to obj indices by adding this offset, see :ObjIndexing
+                int v_offset = chunk.negative_indices() ? -corner_count : static_cast<int>(chunk.v_count) - corner_count + 1;
+                auto element = [&](const int* element_corners, int element_count) {
+                    chunk.l();
+                    for (int c = 0; c < element_count; c++) {
+                        chunk.obj.append(' ');
+                        chunk.format_integer(v_offset + element_corners[c]);
+                    }
+                    if (depths) chunk.attribute().add("depth").insert(depths.at(b, 0));
+                };
+                element(polyline, 10);
+                for (const int* segment : segments) element(segment, 2);
+
+                if (chunk.size() >= chunk.flush_size) {
+                    chunk.flush();
+                }
+            }
+        });
+    }
+
+    // Add `count` 3D boxes with corners given by `mins` and `maxs` (3 coordinates per box) and the optional tree depth
+    // and color of each box, see boxes3
+    template <typename T> BasicObj& boxes3(
+        int count, const T* mins, const T* maxs, const int* depths = nullptr, const Color* colors = nullptr
+    ) {
+        return boxes3(
+            strided<3>(mins, count),
+            strided<3>(maxs, count),
+            strided<1>(depths, count),
+            strided<3>(colors ? &colors->r : nullptr, count, sizeof(Color)));
+    }
+
+
+
+
+    //
+    // Shapes.
+    //
+
+    // Add a sphere with the given center and radius visualized with triangle elements
+    // The resolution of the sphere is determined by `slices` (an orange) and `stacks` (of a wedding cake)
+    BasicObj& sphere3(V3f center, float radius, int slices, int stacks) {
+        V3f lo(center.x - radius, center.y - radius, center.z - radius);
+        V3f hi(center.x + radius, center.y + radius, center.z + radius);
+        if (!admit(lo, hi)) return *this;
+        bool was_budgeted = budgeted;
+        budgeted = false; // The sphere is a single element as far as the budget is concerned
+        const SphereMesh& unit = unit_sphere_mesh(slices, stacks);
+        auto point = [&](uint32_t i) {
+            const float* p = unit.points.data() + 3 * i;
+            return V3(p[0] * radius + center.x, p[1] * radius + center.y, p[2] * radius + center.z);
+        };
+        for (size_t t = 0; t + 3 <= unit.triangles.size(); t += 3) {
+            triangle3(point(unit.triangles[t]), point(unit.triangles[t + 1]), point(unit.triangles[t + 2])).newline();
+        }
+        budgeted = was_budgeted;
+        return *this;
+    }
+
+    // Add a sphere for each center and radius in the given views, visualized with triangle elements. This is much
+    // faster than calling sphere3 for each sphere: every sphere is a copy of the cached unit sphere (see
+    // unit_sphere_mesh) written as an indexed mesh, so its vertices are written once rather than once per triangle.
+    // If `colors` is not empty it should have the same count as `centers`, see color_at. Spheres are not budgeted
+    template <typename T, typename C = uint8_t> BasicObj& spheres3(
+        Strided<T, 3> centers, Strided<T, 1> radii, int slices, int stacks, Strided<C, 3> colors = {}
+    ) {
+        int count = std::min(centers.count, radii.count);
+        if (region.kind != Region::NONE) {
+            std::vector<int> kept;
+            for (int s = 0; s < count; s++) {
+                T r = std::abs(radii.at(s, 0));
+                Vec3<T> center(centers.at(s, 0), centers.at(s, 1), centers.at(s, 2));
+                Bounds bounds;
+                bounds.add(Vec3<T>(center.x - r, center.y - r, center.z - r));
+                bounds.add(Vec3<T>(center.x + r, center.y + r, center.z + r));
+                if (region.overlaps(bounds)) kept.push_back(s);
+            }
+            std::vector<T> kept_centers, kept_radii;
+            std::vector<C> kept_colors;
+            return without_region([&] {
+                spheres3(centers.gather(kept, kept_centers), radii.gather(kept, kept_radii),
+                         slices, stacks, colors.gather(kept, kept_colors));
+            });
+        }
+
+        const SphereMesh& unit = unit_sphere_mesh(slices, stacks);
+        int vertex_count = static_cast<int>(unit.points.size() / 3);
+
+        return parallel_impl(count, [&](BasicObj& chunk, int begin, int end) {
+            chunk.v_count += begin * vertex_count;
+
+            std::vector<T> xyzs(unit.points.size());
+            Strided<T, 3> positions = strided<3>(xyzs.data(), vertex_count);
+            for (int s = begin; s < end; s++) {
+                // Transform the unit sphere, the iterations are independent so the compiler can vectorize this loop
+                T r = radii.at(s, 0);
+                T cx = centers.at(s, 0), cy = centers.at(s, 1), cz = centers.at(s, 2);
+                const float* unit_points = unit.points.data();
+                for (int i = 0; i < vertex_count; i++) {
+                    xyzs[3*i + 0] = static_cast<T>(unit_points[3*i + 0]) * r + cx;
+                    xyzs[3*i + 1] = static_cast<T>(unit_points[3*i + 1]) * r + cy;
+                    xyzs[3*i + 2] = static_cast<T>(unit_points[3*i + 2]) * r + cz;
+                }
+
+                chunk.maybe_start_next_shard(); // Shards can only split files between spheres
+                chunk.after_element = false;
+                if (colors || chunk.quantization.enabled) {
+                    for (int i = 0; i < vertex_count; i++) {
+                        chunk.v().position_at(positions, i);
+                        if (colors) chunk.color_at(colors, s);
+                    }
+                } else {
+                    if (chunk.track_bounds) {
+                        for (int i = 0; i < vertex_count; i++) chunk.written_bounds.add(positions, i);
+                    }
+                    chunk.format_block(xyzs.data(), 3 * vertex_count, 3, "\nv");
+                    chunk.v_count += vertex_count;
+                }
+                chunk.hash_count = 0;
+
+                // Convert 0-based unit sphere indices to obj indices by adding this offset, see :ObjIndexing
+                int v_offset = chunk.negative_indices() ? -vertex_count : static_cast<int>(chunk.v_count) - vertex_count + 1;
+                for (size_t t = 0; t + 3 <= unit.triangles.size(); t += 3) {
+                    chunk.f();
+                    for (int c = 0; c < 3; c++) {
+                        chunk.obj.append(' ');
+                        chunk.format_integer(v_offset + static_cast<int>(unit.triangles[t + c]));
+                    }
+                }
+
+                if (chunk.size() >= chunk.flush_size) {
+                    chunk.flush();
+                }
+            }
+        });
+    }
+
+    // Add `count` spheres with centers given by `XYZs` (3 coordinates per sphere) and radii given by `radii`, see spheres3
+    template <typename T> BasicObj& spheres3(int count, const T* XYZs, const T* radii, int slices, int stacks) {
+        return spheres3(strided<3>(XYZs, count), strided<1>(radii, count), slices, stacks);
+    }
+
+
+
+
+    //
+    // Instancing. A prototype shape is declared once and then placed any number of times, each instance has its own
+    // transform and color. Files with many copies of the same shape (e.g., glyphs, particles or markers) are much
+    // smaller, and the viewer draws the copies with instanced draw calls rather than storing every copy. Instances are
+    // not budgeted, other OBJ readers ignore them, and .prizmb files store them in their PROT and INST sections
+    //
+
+    // Start declaring the prototype called `name`, which must be an identifier (letters, digits and underscores). The
+    // elements written until prototype_end() are in prototype space, they are not shown themselves but define the
+    // shape shown by each instance. Use any of the functions above to write the shape, and declare each prototype once,
+    // before its instances. In sharded streaming mode the prototype is only known in the shard which declares it
+    // Note: writes "\nprototype name" to the obj
+    BasicObj& prototype_begin(const std::string& name) {
+        newline().add("prototype ").add(name);
+        if (prototype_v_count < 0) prototype_v_count = v_count;
+        welded_vertices.clear(); // Prototype elements may only reference prototype vertices
+        return *this;
+    }
+
+    // Finish the prototype declaration started by prototype_begin()
+    // Note: writes "\nprototype_end" to the obj
+    BasicObj& prototype_end() {
+        newline().add("prototype_end");
+
+        // The viewer removes the prototype vertices from the item, so positive indices written later must not count them
+        if (prototype_v_count >= 0) v_count = static_cast<unsigned>(prototype_v_count);
+        prototype_v_count = -1;
+        welded_vertices.clear();
+        return *this;
+    }
+
+    // Add an instance of the prototype `name` with the affine transform whose matrix rows are `row0`, `row1` and
+    // `row2` i.e., the prototype vertex p is shown at (dot(row0, (p,1)), dot(row1, (p,1)), dot(row2, (p,1)))
+    // Note: writes "\ninstance name row0 row1 row2" to the obj
+    template <typename T> BasicObj& instance(const std::string& name, Vec4<T> row0, Vec4<T> row1, Vec4<T> row2) {
+        return newline().add("instance ").add(name).vector4(row0).vector4(row1).vector4(row2);
+    }
+
+    // As above but the instance has color `c`, which is used for all its elements
+    // Note: writes "\ninstance name row0 row1 row2 c.r c.g c.b" to the obj, see color3
+    template <typename T> BasicObj& instance(const std::string& name, Vec4<T> row0, Vec4<T> row1, Vec4<T> row2, Color c) {
+        return instance(name, row0, row1, row2).color3(c);
+    }
+
+    // Add an instance of the prototype `name` which is scaled by `scale` and then moved by `translation`
+    template <typename T> BasicObj& instance(const std::string& name, Vec3<T> translation, Vec3<T> scale) {
+        return instance(name, Vec4<T>{scale.x, 0, 0, translation.x}, Vec4<T>{0, scale.y, 0, translation.y}, Vec4<T>{0, 0, scale.z, translation.z});
+    }
+
+    // As above but the instance has color `c`
+    template <typename T> BasicObj& instance(const std::string& name, Vec3<T> translation, Vec3<T> scale, Color c) {
+        return instance(name, translation, scale).color3(c);
+    }
+
+
+
+
+    //
+    // Obj file configuration functions
+    //
+
+    // Set the number of base-10 digits used to write floating-point numbers to the obj. By default this function is
+    // equivalent to calling `set_precision_to_roundtrip_floats<double>()`
+    //
+    // If the precision is at least max_digits10 for the type being written the number is written using the shortest
+    // decimal text which round-trips, e.g., 0.1 is written as "0.1" rather than "0.10000000000000001". Otherwise numbers
+    // are written like printf's %g format with the given precision.
+    //
+    // This function is useful to improve annotation readability by reducing the number of base-10 digits used to write
+    // float data.  After writing such an annotation you will probably want to restore the value used for coordinate
+    // data, probably by calling this function with no arguments, to restore the precision that round-trips from double
+    // to decimal text to double.
+    BasicObj& set_precision(int n = std::numeric_limits<double>::max_digits10, int* old_n = nullptr) {
+        static_assert(!Policy::is_static, "The precision of this Obj is fixed by its StaticPolicy");
+        if (old_n) *old_n = precision;
+        precision = n;
+        return *this;
+    }
+
+    // Set the number of base-10 digits used to write floating-point numbers to the obj to a value which can round-trip
+    // from Float to decimal text to Float.
+    template <typename Float> BasicObj& set_precision_to_roundtrip_floats(int* old_n = nullptr) {
+        static_assert(std::is_floating_point<Float>::value);
+
+        // "Unlike most mathematical operations, the conversion of a floating-point value to text and back is exact as long
+        // as at least max_digits10 were used (9 for float, 17 for double): it is guaranteed to produce the same
+        // floating-point value, even though the intermediate text representation is not exact. It may take over a hundred
+        // decimal digits to represent the precise value of a float in decimal notation."
+        // https://en.cppreference.com/w/cpp/types/numeric_limits/max_digits10
+        return set_precision(std::numeric_limits<Float>::max_digits10, old_n);
+    }
+
+    // See documentation for `use_negative_indices` member
+    BasicObj& set_use_negative_indices(bool value) {
+        static_assert(!Policy::is_static, "The indexing mode of this Obj is fixed by its StaticPolicy");
+        use_negative_indices = value;
+        return *this;
+    }
+
+    // Set the number of threads used to format large bulk writes e.g., points3, segments3, mesh3 and the strided
+    // polyline/polygon functions. The input is split into `count` chunks which are formatted concurrently and then
+    // spliced together in order, so the output is identical to the output written using a single thread.  Inputs with
+    // fewer than `min_count` elements are always written on the calling thread, since splitting them costs more than
+    // it saves. The other chunks are written by the threads of the shared WorkerPool, which are started on first use
+    BasicObj& set_thread_count(int count, int min_count = 1 << 16) {
+        thread_count = count;
+        parallel_min_count = min_count;
+        return *this;
+    }
+
+    // Write vertex positions as integer coordinates on a grid covering the box with corners `min` and `max`, with a
+    // spacing chosen so that each coordinate is within `max_error` of the value passed to Prizm. This makes files much
+    // smaller and faster to load than files written at the default precision, since every coordinate becomes a short
+    // integer. The grid is written once as a "quantize" directive which the Prizm viewer uses to dequantize positions in
+    // the following v-directives, other OBJ readers will load the grid coordinates. Quantization applies to positions
+    // written by vertex2/vertex3 and the functions which call them (e.g., point3, triangle3, polyline3) and by the bulk
+    // writers, normals, texture coordinates, colors and annotations are unchanged. Positions outside the box are still
+    // written correctly, they just take more digits. The call is ignored if `max_error` is not positive
+    template <typename T> BasicObj& set_quantization(Vec3<T> min, Vec3<T> max, double max_error) {
+        if (!(max_error > 0)) return *this;
+        quantization.enabled = true;
+        for (int d = 0; d < 3; d++) {
+            quantization.min[d] = std::min(min.xyz[d], max.xyz[d]);
+            quantization.max[d] = std::max(min.xyz[d], max.xyz[d]);
+        }
+        quantization.step = 2 * max_error;
+        quantization.inverse_step = 1 / quantization.step;
+        return quantize_directive();
+    }
+
+    // Write full precision vertex positions again, this writes a "quantize" directive with no arguments
+    BasicObj& clear_quantization() {
+        quantization = Quantization();
+        return newline().add("quantize");
+    }
+
+    //
+    // Budgets let you leave Prizm calls in code which runs too often to log every call. They apply to the functions
+    // which write an element together with its vertices (e.g., point3, segment3, triangle3, polyline3, box3_min_max,
+    // sphere3), if the budget drops an element the call and the rest of its call chain (e.g., annotations) only
+    // increment a counter. If elements were dropped a "# Budget dropped N elements" annotation is added to the end of the
+    // file. Note the functions which reference vertices by index (e.g., triangle(i, j, k)) and the bulk writers
+    // (e.g., points3, mesh3) are not budgeted. See SampledObj if you want a uniform random sample of the elements.
+    //
+
+    // Keep only every n-th element, starting with the first
+    BasicObj& set_sample_every(uint64_t n) {
+        sample_every = n > 0 ? n : 1;
+        sample_countdown = 1;
+        return update_budgeted();
+    }
+
+    // Keep at most n elements
+    BasicObj& set_max_elements(uint64_t n) {
+        max_elements = n;
+        return update_budgeted();
+    }
+
+    // Stop keeping elements once the file has at least n bytes, so the file exceeds n bytes by at most one element
+    BasicObj& set_max_bytes(size_t n) {
+        max_bytes = n;
+        return update_budgeted();
+    }
+
+    //
+    // A region of interest drops elements which are entirely outside it, before they are formatted, so you can leave
+    // Prizm calls for a large scene in place and only write the part you are debugging. This applies to the functions
+    // budgets apply to and to the bulk writers points3, segments3 and mesh3, which only write the vertices referenced
+    // by kept elements. The test is conservative: an element is kept if its bounding box touches the region. Dropped
+    // elements are not counted by the budget
+    //
+
+    // Only keep elements whose bounding box overlaps the box with the given corners
+    template <typename T> BasicObj& set_region_aabb(Vec3<T> min, Vec3<T> max) {
+        region.kind = Region::AABB;
+        for (int d = 0; d < 3; d++) {
+            region.min[d] = std::min(min.xyz[d], max.xyz[d]);
+            region.max[d] = std::max(min.xyz[d], max.xyz[d]);
+        }
+        return *this;
+    }
+
+    // Only keep elements whose bounding box overlaps the sphere with the given center and radius
+    template <typename T> BasicObj& set_region_sphere(Vec3<T> center, T radius) {
+        region.kind = Region::SPHERE;
+        region.center[0] = center.x;
+        region.center[1] = center.y;
+        region.center[2] = center.z;
+        region.radius = radius;
+        return *this;
+    }
+
+    // Keep all elements, this is the default
+    BasicObj& clear_region() {
+        region = Region();
+        return *this;
+    }
+
+    // Enable/disable welding mode, see the `welding` member. This works with both negative and positive indices and
+    // greatly reduces the size of meshes written face by face, since each shared vertex is written once rather than
+    // once per face.  Welding applies to point2/3, segment2/3, segment3_vn, triangle2/3, triangle3_vn and the
+    // polyline/polygon/box functions. Disabling welding frees the memory used to find welded vertices
+    // Note: Use mesh3 if your data is already indexed, it is faster and doesn't need extra memory
+    BasicObj& set_welding(bool enabled) {
+        welding = enabled;
+        if (!enabled) {
+            welded_vertices = {};
+            welded_normals = {};
+        }
+        return *this;
+    }
+
+
+
+
+    //
+    // Attributes.
+    //
+    // Attributes are special annotions which are intended to encode numerical data types/colors in annotation strings
+    // by prefixing them with an @ character.  In a future version of Prizm there will be function to parse the encoded
+    // data in order to display or process them specially. Multiple distinct data types placed on the same geometry
+    // element will be supported and the @ character will be used parse them.  Even before this is implemented you might
+    // still prefer to use attributes to annotations if you find having the @ prefix helps you read your annotations
+    // strings more clearly. See Prizm::documentation() for more details.
+    //
+
+    // Start an attribute: Start an annotation string if needed, then add an @ to introduce a new attribute
+    BasicObj& attribute() {
+        return annotation().space().at();
+    }
+
+    // Add an attribute containing the given data to the obj.  Data should be a numerical data type, see attribute()
+    template <typename T> BasicObj& attribute(const T& data) {
+        // Add a space is for legibility.
+        return attribute().insert(data);
+    }
+
+
+
+
+    //
+    // Command Annotations.
+    //
+    // Command Annotations are special annotations which start with #! on a newline (this syntax is inspired by the
+    // "hashbang" character sequence used to introduce an interpreter directive on Unix) and allow you specify Prizm
+    // console commands, with arguments, which should be executed immediately after an the obj file has been loaded.
+    // Command annotations provide a convenient way to configure the item display settings and save you a few clicks.
+    // For example, if you know you want to look annotations you can call `set_annotation_label_visible(true)` to add
+    // a command annotation which will enable annotation visibility after the file is loaded (annotation labelling is
+    // off by default). Note: You can call these functions whenever you like, the command will be written to this->obj
+    // at the point you call them but Prizm will defer execution until the entire file has been parsed.
+    //
+    // (Advanced Note) If you look at the output OBJ file you will notice that command annotations which configure
+    // item state start with a 0, this is a Prizm item index.  The Prizm application has a global array of items
+    // (aka meshes) and the index into this list is often used as the first argument in console commands. When console
+    // commands are executed by the function which load OBJ files as command annotations a _local_ array of items is
+    // created, the item with local index 0 is the item with geometry given in the OBJ if a console command which has
+    // a side effect of generating a new item is executed as a command annotation then this item will have index >0 and
+    // you can pass that value (e.g., to the `item_command` function) to run a console command on one of these
+    // generated items which are not explicitly in the OBJ file.  Note: This complexity is intentionally avoided in
+    // the Prizm::Obj command annotation API, so the functions below are hardcoded to work with item 0 only, but you
+    // can do something like `obj.command("my_command").insert(1).insert("string_argument")` to run "my_command" on the
+    // item with index 1.
+    //
+
+    // Start a command annotation, arguments should be `insert`ed after this
+    BasicObj& command(const std::string& command_name) {
+        return newline().hash().bang().insert(command_name);
+    }
+
+    // Start a command annotation whose first argument is a Prizm item index (See the Advanced Note above)
+    BasicObj& item_command(const std::string& command_name, int item_index = 0) {
+        return command(command_name).insert(item_index);
+    }
+
+    // Annotation labels.  These functions affect annotations on every geometric entity, there are more granular functions as well
+
+    // Set visibility of all annotations
+    BasicObj& set_annotations_visible(bool visible) {
+        return item_command("set_annotations_visible").insert((int)visible);
+    }
+
+    // Set color of all annotation text
+    BasicObj& set_annotations_color(Color color) {
+        return item_command("set_annotations_color").insert(color);
+    }
+
+    // Set scale of all annotation text
+    // The scale parameter is a float in the range [0.2, 1.0], by default Prizm uses 0.4.
+    // TODO :FixScaleParameter The scale parameter is weird, use size in pixels instead
+    BasicObj& set_annotations_scale(float scale) {
+        return item_command("set_annotations_scale").insert(scale);
+    }
+
+
+    // Vertex labels
+
+    // Set visibility of vertex annotations i.e., annotations on obj file v-directive data
+    BasicObj& set_vertex_annotations_visible(bool visible) {
+        return item_command("set_vertex_annotations_visible").insert((int)visible);
+    }
+
+    //set_vertex_annotations_color not implemented (do we want this granularity? using set_annotations_color seems sufficient)
+    //set_vertex_annotations_scale not implemented (do we want this granularity? using set_annotations_scale seems sufficient)
+
+    // Set visibility of vertex index labels i.e., 0-based indices into the obj file v-directive data
+    BasicObj& set_vertex_index_labels_visible(bool visible) {
+        return item_command("set_vertex_index_labels_visible").insert((int)visible);
+    }
+
+    // Set visibility of vertex position labels i.e., the coordinates of the obj file v-directive data
+    BasicObj& set_vertex_position_labels_visible(bool visible) {
+        return item_command("set_vertex_position_labels_visible").insert((int)visible);
+    }
+
+    // Set color of vertex index/position labels
+    BasicObj& set_vertex_label_color(Color color) {
+        return item_command("set_vertex_label_color").insert(color);
+    }
+
+    // Set scale of vertex index/position labels
+    // The scale parameter is a float in the range [0.2, 1.0], by default Prizm uses 0.4 (see :FixScaleParameter)
+    BasicObj& set_vertex_label_scale(float scale) {
+        return item_command("set_vertex_label_scale").insert(scale);
+    }
+
+
+    // Point labels
+
+    // Set visibility of point annotations i.e., annotations on obj file p-directive data
+    BasicObj& set_point_annotations_visible(bool visible) {
+        return item_command("set_point_annotations_visible").insert((int)visible);
+    }
+
+    //set_point_annotations_color not implemented (do we want this granularity? using set_annotations_color seems sufficient)
+    //set_point_annotations_scale not implemented (do we want this granularity? using set_annotations_scale seems sufficient)
+
+    // Set visibility of point element index labels i.e., 0-based indices into the obj file p-directive data
+    // Note: set_vertex_index_labels_visible is probably the function you want!
+    BasicObj& set_point_index_labels_visible(bool visible) {
+        return item_command("set_point_index_labels_visible").insert((int)visible);
+    }
+
+    // Set color of point index labels
+    // Note: set_vertex_label_color is probably the function you want!
+    BasicObj& set_point_label_color(Color color) {
+        return item_command("set_point_label_color").insert(color);
+    }
+
+    // Set scale of point index labels
+    // The scale parameter is a float in the range [0.2, 1.0], by default Prizm uses 0.4 (see :FixScaleParameter)
+    // Note: set_vertex_label_scale is probably the function you want!
+    BasicObj& set_point_label_scale(float scale) {
+        return item_command("set_point_label_scale").insert(scale);
+    }
+
+
+    // Segment labels
+
+    // Set visibility of segment annotations i.e., annotations on obj file l-directive data
+    BasicObj& set_segment_annotations_visible(bool visible) {
+        return item_command("set_segment_annotations_visible").insert((int)visible);
+    }
+
+    //set_segment_annotations_color not implemented (do we want this granularity? using set_annotations_color seems sufficient)
+    //set_segment_annotations_scale not implemented (do we want this granularity? using set_annotations_scale seems sufficient)
+
+    // Set visibility of segment element index labels i.e., 0-based indices into the obj file l-directive data
+    BasicObj& set_segment_index_labels_visible(bool visible = true) {
+        return item_command("set_segment_index_labels_visible").insert((int)visible);
+    }
+
+    // Set color of segment index labels
+    BasicObj& set_segment_label_color(Color color) {
+        return item_command("set_segment_label_color").insert(color);
+    }
+
+    // Set scale of segment index labels
+    // The scale parameter is a float in the range [0.2, 1.0], by default Prizm uses 0.4 (see :FixScaleParameter)
+    BasicObj& set_segment_label_scale(float scale) {
+        return item_command("set_segment_label_scale").insert(scale);
+    }
+
+
+    // Triangle labels
+
+    // Set visibility of triangle annotations i.e., annotations on obj file f-directive data
+    BasicObj& set_triangle_annotations_visible(bool visible) {
+        return item_command("set_triangle_annotations_visible").insert((int)visible);
+    }
+
+    //set_triangle_annotations_color not implemented (do we want this granularity? using set_annotations_color seems sufficient)
+    //set_triangle_annotations_scale not implemented (do we want this granularity? using set_annotations_scale seems sufficient)
+
+    // Set visibility of triangle element index labels i.e., 0-based indices into the obj file f-directive data
+    BasicObj& set_triangle_index_labels_visible(bool visible = true) {
+        return item_command("set_triangle_index_labels_visible").insert((int)visible);
+    }
+
+    // Set color of triangle index labels
+    BasicObj& set_triangle_label_color(Color color) {
+        return item_command("set_triangle_label_color").insert(color);
+    }
+
+    // Set scale of triangle index labels
+    // The scale parameter is a float in the range [0.2, 1.0], by default Prizm uses 0.4 (see :FixScaleParameter)
+    BasicObj& set_triangle_label_scale(float scale) {
+        return item_command("set_triangle_label_scale").insert(scale);
+    }
+
+
+    // Vertex rendering
+
+    // Set visibility of vertices i.e., obj file v-directive data
+    BasicObj& set_vertices_visible(bool visible = true) {
+        return item_command("set_vertices_visible").insert((int)visible);
+    }
+
+    // Set color of vertices i.e., obj file v-directive data
+    BasicObj& set_vertices_color(Color color) {
+        return item_command("set_vertices_color").insert(color);
+    }
+
+    // Set size/radius of vertices i.e., obj file v-directive data
+    BasicObj& set_vertices_size(int size) {
+        return item_command("set_vertices_size").insert(size);
+    }
+
+
+    // Point rendering
+
+    // Set visibility of points i.e., obj file p-directive data
+    // Note: set_vertices_visible is probably the function you want!
+    BasicObj& set_points_visible(bool visible) {
+        return item_command("set_points_visible").insert((int)visible);
+    }
+
+    // Set color of points i.e., obj file p-directive data
+    // Note: set_vertices_color is probably the function you want!
+    BasicObj& set_points_color(Color color) {
+        return item_command("set_points_color").insert(color);
+    }
+
+    // Set size/radius of points i.e., obj file p-directive data
+    // Note: set_vertices_size is probably the function you want!
+    BasicObj& set_points_size(int size) {
+        return item_command("set_points_size").insert(size);
+    }
+
+    // Set visibility of point normals i.e., the normals referenced by obj file p-directive data
+    BasicObj& set_point_normals_visible(bool visible) {
+        return item_command("set_point_normals_visible").insert((int)visible);
+    }
+
+    // Show point normals as vectors multiplied by `scale`, e.g., the glyphs written by vectors3. If `normalized` is
+    // true the normals are normalized first, so every vector has length `scale`
+    BasicObj& set_point_normals_scale(float scale, bool normalized = false) {
+        return item_command("set_point_normals_scale").insert(scale).insert((int)normalized);
+    }
+
+
+    // Segment rendering
+
+    // Set visibility of segments i.e., obj file l-directive data
+    BasicObj& set_segments_visible(bool visible) {
+        return item_command("set_segments_visible").insert((int)visible);
+    }
+
+    // Set color of segments i.e., obj file l-directive data
+    BasicObj& set_segments_color(Color color) {
+        return item_command("set_segments_color").insert(color);
+    }
+
+    // Set width of segments i.e., obj file l-directive data
+    BasicObj& set_segments_width(float width) {
+        return item_command("set_segments_width").insert(width);
+    }
+
+
+    // Edges rendering. Applies to triangle edges, but not segment elements.
+
+    // Set visibility of triangle edges i.e., obj file f-directive data
+    BasicObj& set_edges_visible(bool visible) {
+        return item_command("set_edges_visible").insert((int)visible);
+    }
+
+    // Set color of triangle edges i.e., obj file f-directive data
+    BasicObj& set_edges_color(Color color) {
+        return item_command("set_edges_color").insert(color);
+    }
+
+    // Set width of triangle edges i.e., obj file f-directive data
+    BasicObj& set_edges_width(float width) {
+        return item_command("set_edges_width").insert(width);
+    }
+
+
+    // Triangle rendering
+
+    // Set visibility of triangles i.e., obj file f-directive data
+    BasicObj& set_triangles_visible(bool visible) {
+        return item_command("set_triangles_visible").insert((int)visible);
+    }
+
+    // Set color of triangles i.e., obj file f-directive data
+    BasicObj& set_triangles_color(Color color) {
+        return item_command("set_triangles_color").insert(color);
+    }
+
+
+
+
+
+    //
+    // Implementation methods
+    //
+
+    // Format a number, string or Prizm type into the buffer, see add()
+    template <typename T> void format(const T& anything) {
+        if constexpr (std::is_same<T, bool>::value) {
+            format_integer(static_cast<int>(anything));
+        } else if constexpr (std::is_same<T, char>::value || std::is_same<T, signed char>::value || std::is_same<T, unsigned char>::value) {
+            // Match operator<<, which writes these as characters
+            obj.append(static_cast<char>(anything));
+        } else if constexpr (std::is_integral<T>::value) {
+            format_integer(anything);
+        } else if constexpr (std::is_floating_point<T>::value) {
+            format_float(anything);
+        } else if constexpr (std::is_convertible<const T&, std::string_view>::value) {
+            std::string_view text = anything;
+            obj.append(text.data(), text.size());
+        } else {
+            // Fallback for user types which define operator<<
+            std::ostringstream os;
+            os.precision(digits());
+            os << anything;
+            std::string text = os.str();
+            obj.append(text.data(), text.size());
+        }
+    }
+
+    template <typename T> void format(const Vec2<T>& v) {
+        format(v.x); obj.append(' '); format(v.y);
+    }
+
+    template <typename T> void format(const Vec3<T>& v) {
+        format(v.x); obj.append(' '); format(v.y); obj.append(' '); format(v.z);
+    }
+
+    template <typename T> void format(const Vec4<T>& v) {
+        format(v.x); obj.append(' '); format(v.y); obj.append(' '); format(v.z); obj.append(' '); format(v.w);
+    }
+
+    void format(const Color& c) {
+        // Cast to int so we don't write chars
+        format_integer((int)c.r); obj.append(' ');
+        format_integer((int)c.g); obj.append(' ');
+        format_integer((int)c.b); obj.append(' ');
+        format_integer((int)c.a);
+    }
+
+    template <typename Int> void format_integer(Int value) {
+        constexpr size_t max_chars = std::numeric_limits<Int>::digits10 + 3; // Sign and an extra digit
+        char* first = obj.reserve(max_chars);
+        std::to_chars_result result = std::to_chars(first, first + max_chars, value);
+        obj.commit(result.ptr - first);
+    }
+
+    template <typename Float> void format_float(Float value) {
+        char* first = obj.reserve(max_float_chars());
+        obj.commit(to_chars_float(first, value) - first);
+    }
+
+    // Enough for the sign, digits, decimal point and exponent of a float written at any precision
+    size_t max_float_chars() const {
+        return 64 + static_cast<size_t>(digits() > 0 ? digits() : 0);
+    }
+
+    // Write value at first, which must have max_float_chars() bytes available, and return the end of the written text
+    template <typename Float> char* to_chars_float(char* first, Float value) const {
+        char* last = first + max_float_chars();
+        std::to_chars_result result = digits() >= std::numeric_limits<Float>::max_digits10
+            ? std::to_chars(first, last, value)
+            : std::to_chars(first, last, value, std::chars_format::general, digits());
+        return result.ptr;
+    }
+
+    // Format `count` numbers into the buffer, writing a space before each one and writing `prefix` before each group
+    // of `group_size` numbers (if `group_size` is not 0) and calling `group_end(g)` after the g-th group if it is given,
+    // e.g., to write an element referencing each vertex. This is the kernel used by the bulk writers: it reserves
+    // capacity once per block and first classifies a whole block of floats, in a loop the compiler can vectorize, so
+    // that integral values, which are common in debug data, have their digits generated by the DecimalKernel rather
+    // than by the float conversion. The other floats and doubles written at full precision are converted by the
+    // ShortestKernel, whose significands are also split into 7-digit parts for the DecimalKernel
+    template <typename T, typename GroupEnd = std::nullptr_t>
+    void format_block(const T* values, int count, int group_size = 0, std::string_view prefix = {}, GroupEnd group_end = nullptr) {
+        constexpr bool has_group_end = !std::is_same<GroupEnd, std::nullptr_t>::value;
+        if constexpr (!std::is_floating_point<T>::value) {
+            for (int i = 0; i < count; i++) {
+                if (group_size && i % group_size == 0) obj.append(prefix.data(), prefix.size());
+                obj.append(' ');
+                format(values[i]);
+                if constexpr (has_group_end) {
+                    if ((i + 1) % group_size == 0) group_end(i / group_size);
+                }
+            }
+        } else {
+            // Below this magnitude integral values are written identically by to_chars_float and the integer path.
+            // The shortest representation switches to exponent notation from 1e5 (e.g., "1e+05"), %g-style formatting
+            // at precision p does so from 10^p
+            T max_integral = 100000;
+            if (digits() < std::numeric_limits<T>::max_digits10) {
+                max_integral = 1;
+                for (int d = 0; d < digits() && d < 7; d++) max_integral *= 10;
+            }
+
+            // Significands have at most 9 digits for floats and 15 for doubles, so 2 or 3 parts
+            constexpr bool has_shortest = std::is_same<T, float>::value || std::is_same<T, double>::value;
+            constexpr int part_count = std::is_same<T, float>::value ? 2 : 3;
+            bool full_precision = has_shortest && digits() >= std::numeric_limits<T>::max_digits10;
+
+            constexpr int block_size = 4 * DecimalKernel::block_size;
+            bool integral[block_size];
+            int32_t integers[block_size];
+            int32_t lengths[block_size];
+            char fields[8 * block_size + 8]; // The digits of the last value may be read with 8 bytes after them
+            T others[block_size]; // The values which aren't integral
+            double significands[block_size];
+            int32_t exponents[block_size];
+            int32_t parts[part_count * block_size];
+            int32_t part_lengths[part_count * block_size];
+            char part_fields[8 * part_count * block_size];
+            size_t max_chars = 1 + max_float_chars() + prefix.size();
+
+            for (int block_start = 0; block_start < count; block_start += block_size) {
+                int n = count - block_start < block_size ? count - block_start : block_size;
+                const T* block = values + block_start;
+
+                int integral_count = 0;
+                int other_count = 0;
+                for (int i = 0; i < n; i++) {
+                    T value = block[i];
+                    bool in_range = (value > -max_integral) & (value < max_integral);
+                    integers[i] = static_cast<int32_t>(in_range ? value : T(0));
+                    integral[i] = in_range & (static_cast<T>(integers[i]) == value) & !((value == 0) & std::signbit(value));
+                    integral_count += integral[i];
+                    others[other_count] = value;
+                    other_count += !integral[i];
+                }
+
+                // A few integral values, e.g., the coordinates of a single vertex, are cheaper to convert one by one.
+                // The kernel converts whole groups of values, so the last group is padded with zeros
+                bool use_kernel = integral_count >= DecimalKernel::block_size / 2;
+                if (use_kernel) {
+                    int padded = (n + DecimalKernel::block_size - 1) / DecimalKernel::block_size * DecimalKernel::block_size;
+                    for (int i = n; i < padded; i++) integers[i] = 0;
+                    for (int k = 0; k < padded; k += DecimalKernel::block_size) {
+                        DecimalKernel::digits(integers + k, fields + 8 * k, lengths + k);
+                    }
+                }
+
+                // Likewise for the other values, the ShortestKernel returns false if the CPU isn't supported
+                bool use_shortest = full_precision && other_count >= ShortestKernel::block_size / 2;
+                if (use_shortest && shortest_skip_count > 0) {
+                    shortest_skip_count -= 1;
+                    use_shortest = false;
+                }
+                if (use_shortest) {
+                    int padded = (other_count + ShortestKernel::block_size - 1) / ShortestKernel::block_size * ShortestKernel::block_size;
+                    for (int i = other_count; i < padded; i++) others[i] = 0;
+                    for (int k = 0; k < padded && use_shortest; k += ShortestKernel::block_size) {
+                        use_shortest = ShortestKernel::shortest(others + k, significands + k, exponents + k);
+                    }
+                }
+                if (use_shortest) {
+                    int fallback_count = 0;
+                    for (int k = 0; k < other_count; k++) {
+                        fallback_count += exponents[k] == ShortestKernel::fallback;
+                        auto significand = static_cast<int64_t>(significands[k]);
+                        int32_t* part = parts + part_count * k;
+                        if constexpr (part_count == 3) {
+                            part[0] = static_cast<int32_t>(significand / 100000000000000);
+                            significand %= 100000000000000;
+                        }
+                        part[part_count - 2] = static_cast<int32_t>(significand / 10000000);
+                        part[part_count - 1] = static_cast<int32_t>(significand % 10000000);
+                    }
+                    if (2 * fallback_count > other_count) shortest_skip_count = 16;
+                    int padded = (part_count * other_count + DecimalKernel::block_size - 1) / DecimalKernel::block_size * DecimalKernel::block_size;
+                    for (int i = part_count * other_count; i < padded; i++) parts[i] = 0;
+                    for (int k = 0; k < padded; k += DecimalKernel::block_size) {
+                        DecimalKernel::digits(parts + k, part_fields + 8 * k, part_lengths + k);
+                    }
+                }
+
+                char* first = obj.reserve(n * max_chars);
+                char* last = first;
+                int other = 0;
+                for (int i = 0; i < n; i++) {
+                    if (group_size && (block_start + i) % group_size == 0) {
+                        std::memcpy(last, prefix.data(), prefix.size());
+                        last += prefix.size();
+                    }
+                    *last++ = ' ';
+                    if (integral[i] && use_kernel) {
+                        if (integers[i] < 0) *last++ = '-';
+                        std::memcpy(last, fields + 8 * i + 8 - lengths[i], 8);
+                        last += lengths[i];
+                    } else if (integral[i]) {
+                        last = std::to_chars(last, last + 9, integers[i]).ptr;
+                    } else {
+                        // The significand padded with '0's is the 8 digits of its first part followed by the last 7
+                        // digits of each other part
+                        char* end = nullptr;
+                        if (use_shortest && exponents[other] != ShortestKernel::fallback) {
+                            char digits[8 * part_count + 16];
+                            int k = part_count * other;
+                            std::memcpy(digits, part_fields + 8 * k, 8);
+                            for (int p = 1; p < part_count; p++) {
+                                std::memcpy(digits + 7 * p + 1, part_fields + 8 * (k + p) + 1, 7);
+                            }
+                            int length = part_lengths[k + part_count - 1];
+                            for (int p = part_count - 2; p >= 0; p--) {
+                                length = parts[k + p] != 0 ? part_lengths[k + p] + 7 * (part_count - 1 - p) : length;
+                            }
+                            end = ShortestKernel::write(last, block[i] < 0, digits + 7 * part_count + 1 - length, length,
+                                exponents[other]);
+                        }
+                        last = end ? end : to_chars_float(last, block[i]);
+                        other++;
+                    }
+
+                    // The callback may append to the obj, so the text is committed first
+                    if constexpr (has_group_end) {
+                        if ((block_start + i + 1) % group_size == 0) {
+                            obj.commit(last - first);
+                            group_end((block_start + i) / group_size);
+                            first = last = obj.reserve((n - i - 1) * max_chars);
+                        }
+                    }
+                }
+                obj.commit(last - first);
+            }
+        }
+    }
+
+    // Write the coordinates of a vertex position, which are quantized if set_quantization was called
+    template <typename T> BasicObj& position(Vec2<T> a) {
+        if (track_bounds && !skipping) written_bounds.add(a);
+        if (!quantization.enabled) return vector2(a);
+        format_quantized(a.x, 0);
+        format_quantized(a.y, 1);
+        return *this;
+    }
+
+    template <typename T> BasicObj& position(Vec3<T> a) {
+        if (track_bounds && !skipping) written_bounds.add(a);
+        if (!quantization.enabled) return vector3(a);
+        format_quantized(a.x, 0);
+        format_quantized(a.y, 1);
+        format_quantized(a.z, 2);
+        return *this;
+    }
+
+    // Write the coordinates of the i-th vertex position in the view, see position
+    template <typename T, int N> BasicObj& position_at(const Strided<T, N>& view, int i) {
+        if (track_bounds && !skipping) written_bounds.add(view, i);
+        if (!quantization.enabled) return vector_at(view, i);
+        for (int d = 0; d < N; d++) format_quantized(view.at(i, d), d);
+        return *this;
+    }
+
+    // Write " q" where q is the grid coordinate of `value` along axis d, see Quantization
+    void format_quantized(double value, int d) {
+        if (skipping) return;
+        double q = quantization.quantize(value, d);
+        obj.append(' ');
+        if (Quantization::is_integer(q)) format_integer(static_cast<int64_t>(q));
+        else format_float(q);
+    }
+
+    // Write the coordinates of the i-th vector in the view
+    template <typename T, int N> BasicObj& vector_at(const Strided<T, N>& view, int i) {
+        T values[N];
+        for (int d = 0; d < N; d++) {
+            values[d] = view.at(i, d);
+        }
+        format_block(values, N);
+        return *this;
+    }
+
+    // Write a v-, vn- or vt-directive (given by `directive`, e.g., "v") for every vector in the view and add the number
+    // of directives written to the `directive_count` member. Equivalent to, but much faster than, calling v().vector_at()
+    template <typename T, int N> BasicObj& vectors_impl(std::string_view directive, unsigned BasicObj::* directive_count, const Strided<T, N>& view) {
+        bool positions = directive_count == &BasicObj::v_count;
+        if (positions && view.count > 0) {
+            maybe_start_next_shard();
+            after_element = false;
+        }
+        return parallel_impl(view.count, [&](BasicObj& chunk, int begin, int end) {
+            chunk.*directive_count += begin;
+
+            if (chunk.quantization.enabled && positions) {
+                for (int i = begin; i < end; i++) {
+                    chunk.v().position_at(view, i);
+                    if (chunk.size() >= chunk.flush_size) chunk.flush();
+                }
+                chunk.hash_count = 0;
+                return;
+            }
+
+            constexpr int block_size = 8;
+            T values[block_size * N];
+
+            char prefix[4] = {'\n'};
+            std::memcpy(prefix + 1, directive.data(), directive.size() < 3 ? directive.size() : 3);
+
+            for (int block_start = begin; block_start < end; block_start += block_size) {
+                int n = end - block_start < block_size ? end - block_start : block_size;
+                for (int i = 0; i < n; i++) {
+                    for (int d = 0; d < N; d++) {
+                        values[i * N + d] = view.at(block_start + i, d);
+                    }
+                    if (positions && chunk.track_bounds) chunk.written_bounds.add(view, block_start + i);
+                }
+                chunk.format_block(values, n * N, N, std::string_view(prefix, 1 + directive.size()));
+                chunk.*directive_count += n;
+                chunk.hash_count = 0;
+
+                if (chunk.size() >= chunk.flush_size) {
+                    chunk.flush();
+                }
+            }
+        });
+    }
+
+    // Add the text in `buffer` to the end of the Obj, by adding it to the rope if it is large enough that this is
+    // cheaper than copying it
+    void splice(Buffer&& buffer) {
+        constexpr size_t min_splice_count = 4096;
+        if (buffer.count < min_splice_count) {
+            obj.append(buffer.data, buffer.count);
+            buffer.clear();
+            return;
+        }
+        if (obj.count) {
+            rope_count += obj.count;
+            std::pmr::memory_resource* resource = obj.resource;
+            rope.push_back(std::move(obj));
+            obj.resource = resource;
+        }
+        rope_count += buffer.count;
+        rope.push_back(std::move(buffer));
+    }
+
+    static bool is_lz4_filename(const std::string& filename) {
+        return filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".lz4") == 0;
+    }
+
+    static bool is_prizmb_filename(const std::string& filename) {
+        return filename.size() >= 7 && filename.compare(filename.size() - 7, 7, ".prizmb") == 0;
+    }
+
+    // Write the quantization grid using round-trip precision so dequantization is exact regardless of set_precision
+    BasicObj& quantize_directive() {
+        newline().add("quantize");
+        double values[7] = {
+            quantization.min[0], quantization.min[1], quantization.min[2],
+            quantization.max[0], quantization.max[1], quantization.max[2], quantization.step};
+        for (double value : values) {
+            char* first = obj.reserve(32);
+            *first = ' ';
+            obj.commit(std::to_chars(first + 1, first + 32, value).ptr - first);
+        }
+        return *this;
+    }
+
+    // In sharded streaming mode start a new shard if the current one is full and the next vertex can't be referenced
+    // by an element in the current shard
+    void maybe_start_next_shard() {
+        if (shards.max_size > 0 && after_element && prototype_v_count < 0 && flushed_count - shards.begin + size() >= shards.max_size) {
+            start_next_shard();
+        }
+    }
+
+    void start_next_shard() {
+        flush();
+        if (compressor) {
+            compressor->end_frame();
+            file.write(compressor->frame.data, compressor->frame.count);
+            compressor = std::make_unique<Lz4Encoder>();
+        }
+        file.close();
+        finish_shard();
+
+        shards.index += 1;
+        shards.begin = flushed_count;
+        shards.v_begin = v_count;
+        written_bounds = Bounds();
+        file.open(shards.filename(shards.index), std::ofstream::out | std::ofstream::trunc | std::ofstream::binary);
+        write_manifest();
+
+        // Vertices in the previous shard can't be reused, and the new shard needs the grid to dequantize its positions
+        welded_vertices.clear();
+        welded_normals.clear();
+        if (quantization.enabled) quantize_directive();
+        after_element = false;
+    }
+
+    // Returns "shard <filename>" for the current shard, the filename is relative to the manifest
+    std::string shard_entry() const {
+        std::string filename = shards.filename(shards.index);
+        size_t slash = filename.find_last_of("/\\");
+        return "shard " + filename.substr(slash == std::string::npos ? 0 : slash + 1);
+    }
+
+    // Add the current shard to the finished shards of the manifest. Each line is
+    // "shard <filename> <vertex count> <min x y z> <max x y z>"
+    void finish_shard() {
+        shards.manifest += shard_entry() + " " + std::to_string(v_count - shards.v_begin);
+        for (double value : {written_bounds.lo[0], written_bounds.lo[1], written_bounds.lo[2], written_bounds.hi[0], written_bounds.hi[1], written_bounds.hi[2]}) {
+            char buffer[32];
+            shards.manifest += ' ';
+            shards.manifest.append(buffer, std::to_chars(buffer, buffer + sizeof(buffer), value).ptr);
+        }
+        shards.manifest += '\n';
+    }
+
+    // Rewrite the manifest, so it is valid if the program crashes later. While a shard is being written it is listed
+    // after the finished shards without a vertex count and bounds, which are only known when it is finished
+    void write_manifest() {
+        std::ofstream manifest(shards.manifest_filename(), std::ofstream::out | std::ofstream::trunc | std::ofstream::binary);
+        manifest << "# Prizm shard manifest, see Prizm::Obj\n" << shards.manifest;
+        if (file.is_open()) manifest << shard_entry() << '\n';
+    }
+
+#ifndef _WIN32
+    // Write the pieces to the file using writev, resuming after partial writes
+    static void write_pieces(int fd, iovec* pieces, size_t piece_count) {
+        constexpr size_t max_pieces = 1024; // The minimum IOV_MAX allowed by POSIX
+        while (piece_count > 0) {
+            ssize_t written = writev(fd, pieces, static_cast<int>(std::min(piece_count, max_pieces)));
+            if (written < 0) {
+                return;
+            }
+            while (piece_count > 0 && static_cast<size_t>(written) >= pieces->iov_len) {
+                written -= pieces->iov_len;
+                pieces++;
+                piece_count--;
+            }
+            if (piece_count > 0) {
+                pieces->iov_base = static_cast<char*>(pieces->iov_base) + written;
+                pieces->iov_len -= written;
+            }
+        }
+    }
+#endif
+
+    // Call `write_chunk(BasicObj& chunk, int begin, int end)` to write the elements with indices in [begin, end), for a
+    // partition of [0, count) into chunks. If the thread count and `count` are large enough the chunks are written to
+    // temporary Objs by the WorkerPool and then appended to this one in order, otherwise `write_chunk` is called
+    // once with `*this`. Each temporary Obj starts with the state of this Obj (precision, indexing mode and counts), so
+    // `write_chunk` must add the number of vertices written by the preceding chunks to the counts if it uses them
+    template <typename WriteChunk> BasicObj& parallel_impl(int count, WriteChunk write_chunk) {
+        if (thread_count <= 1 || count < parallel_min_count) {
+            write_chunk(*this, 0, count);
+            return *this;
+        }
+
+        std::vector<BasicObj> chunks(thread_count);
+        for (int c = 0; c < thread_count; c++) {
+            BasicObj& chunk = chunks[c];
+            chunk.precision = precision;
+            chunk.use_negative_indices = use_negative_indices;
+            chunk.quantization = quantization;
+            chunk.track_bounds = track_bounds;
+            chunk.after_element = after_element;
+            chunk.hash_count = hash_count;
+            chunk.v_count = v_count;
+            chunk.vn_count = vn_count;
+            chunk.vt_count = vt_count;
+        }
+
+        auto write = [&](int c) {
+            int begin = static_cast<int>(static_cast<int64_t>(count) * c / thread_count);
+            int end = static_cast<int>(static_cast<int64_t>(count) * (c + 1) / thread_count);
+            write_chunk(chunks[c], begin, end);
+        };
+        WorkerPool::shared().run(thread_count, write);
+
+        for (BasicObj& chunk : chunks) {
+            splice(std::move(chunk.obj));
+            if (size() >= flush_size) {
+                flush();
+            }
+            written_bounds.add(chunk.written_bounds);
+        }
+
+        // The last chunk ends where the serial writer would have ended
+        after_element = chunks.back().after_element;
+        hash_count = chunks.back().hash_count;
+        v_count = chunks.back().v_count;
+        vn_count = chunks.back().vn_count;
+        vt_count = chunks.back().vt_count;
+        return *this;
+    }
+
+    // Write the i-th color in the view. Integer components are assumed to be in the range [0,255] and are rescaled
+    // to [0,1] (see color3), floating-point components are written unchanged
+    template <typename C> BasicObj& color_at(const Strided<C, 3>& colors, int i) {
+        for (int d = 0; d < 3; d++) {
+            if constexpr (std::is_integral<C>::value) {
+                insert(colors.at(i, d) / 255.f);
+            } else {
+                insert(colors.at(i, d));
+            }
+        }
+        return *this;
+    }
+
+    // Writes a polyline or a triangle fan. If closed is true the first point index is written again at the end
+    template <typename T, int N> BasicObj& poly_impl(char directive, Strided<T, N> points, bool closed = false) {
+        int min_count = directive == 'f' ? 3 : 2;
+        if (points.count < min_count) {
+            return *this;
+        }
+
+        if (region.kind != Region::NONE) {
+            Bounds bounds;
+            for (int i = 0; i < points.count; i++) bounds.add(points, i);
+            if (!admit_bounds(bounds)) return *this;
+        }
+        if (!admit_budget()) return *this;
+
+        if (welding) {
+            for (int i = 0; i < points.count; i++) {
+                if constexpr (N == 2) weld(Vec2<T>(points.at(i, 0), points.at(i, 1)));
+                else weld(Vec3<T>(points.at(i, 0), points.at(i, 1), points.at(i, 2)));
+            }
+            return welded_element(directive, closed);
+        }
+
+        vectors_impl("v", &BasicObj::v_count, points);
+
+        directive == 'f' ? f() : l();
+        for (int i = -points.count; i < 0; i++) {
+            insert(v_index(i));
+        }
+
+        if (closed) insert(v_index(-points.count));
+
+        // No newline so the caller can add an annotation
+
+        return *this;
+    }
+
+    // Write 2D vertex positions as a variadic call
+    template <typename T> BasicObj& vertex2_variadic(int point_count, Vec2<T> p1, Vec2<T> p2, Vec2<T> p3, va_list va) {
+        if (welding) {
+            weld(p1).weld(p2).weld(p3);
+        } else {
+            vertex2(p1).vertex2(p2).vertex2(p3);
+        }
+        for (int i = 0; i < point_count-3; i++) {
+            Vec2<T> pn = va_arg(va, Vec2<T>);
+            welding ? weld(pn) : vertex2(pn);
+        }
+        // No newline so the caller can add an annotation
+        return *this;
+    }
+
+    // Write 3D vertex positions as a variadic call
+    template <typename T> BasicObj& vertex3_variadic(int point_count, Vec3<T> p1, Vec3<T> p2, Vec3<T> p3, va_list va) {
+        if (welding) {
+            weld(p1).weld(p2).weld(p3);
+        } else {
+            vertex3(p1).vertex3(p2).vertex3(p3);
+        }
+        for (int i = 0; i < point_count-3; i++) {
+            Vec3<T> pn = va_arg(va, Vec3<T>);
+            welding ? weld(pn) : vertex3(pn);
+        }
+        // No newline so the caller can add an annotation
+        return *this;
+    }
+
+    // Returns true if the next element, with the given vertices, is not entirely outside the region of interest and the
+    // budget keeps it, otherwise the rest of the call chain is skipped, see add()
+    template <typename... Vertices> bool admit(const Vertices&... vertices) {
+        if constexpr (sizeof...(Vertices) > 0) {
+            if (region.kind != Region::NONE) {
+                Bounds bounds;
+                (bounds.add(vertices), ...);
+                if (!admit_bounds(bounds)) return false;
+            }
+        }
+        return admit_budget();
+    }
+
+    // Returns true if the bounds overlap the region of interest, otherwise the rest of the call chain is skipped
+    bool admit_bounds(const Bounds& bounds) {
+        if (region.overlaps(bounds)) return true;
+        skipping = true;
+        return false;
+    }
+
+    // See admit, this reads the vertices after p3 from a copy of `va` so the caller can still write them
+    template <typename V> bool admit_variadic(int point_count, V p1, V p2, V p3, va_list va) {
+        if (region.kind != Region::NONE) {
+            Bounds bounds;
+            bounds.add(p1);
+            bounds.add(p2);
+            bounds.add(p3);
+            va_list copy;
+            va_copy(copy, va);
+            for (int i = 0; i < point_count-3; i++) bounds.add(va_arg(copy, V));
+            va_end(copy);
+            if (!admit_bounds(bounds)) return false;
+        }
+        return admit_budget();
+    }
+
+    // Calls `write` with the region of interest cleared, used by the bulk writers after they dropped elements
+    template <typename Writer> BasicObj& without_region(Writer&& writer) {
+        Region saved = region;
+        region = Region();
+        writer();
+        region = saved;
+        return *this;
+    }
+
+    // Returns true if the budget keeps the next element, see set_sample_every, set_max_elements and set_max_bytes
+    bool admit_budget() {
+        maybe_start_next_shard();
+        if (!budgeted) return true;
+        if (--sample_countdown > 0 || kept_count >= max_elements || flushed_count + size() >= max_bytes) {
+            dropped_count++;
+            skipping = true;
+            return false;
+        }
+        sample_countdown = sample_every;
+        kept_count++;
+        return true;
+    }
+
+    BasicObj& update_budgeted() {
+        budgeted = sample_every > 1
+            || max_elements != std::numeric_limits<uint64_t>::max()
+            || max_bytes != std::numeric_limits<size_t>::max();
+        return *this;
+    }
+
+    // Returns the annotation written at the end of the file if the budget dropped elements
+    std::string budget_annotation() const {
+        return dropped_count ? "\n# Budget dropped " + std::to_string(dropped_count) + " elements" : std::string();
+    }
+
+    // Find or write a vertex in welding mode, and add its index to the element being written, see welded_element
+    template <typename T> BasicObj& weld(Vec2<T> a, const Color* c = nullptr) {
+        WeldKey key = weld_key(2, a.x, a.y, T(0), c);
+        auto found = welded_vertices.try_emplace(key, 0);
+        if (found.second) {
+            c ? vertex2(a, *c) : vertex2(a);
+            found.first->second = v_count;
+        }
+        element_vertices.push_back(found.first->second);
+        return *this;
+    }
+
+    template <typename T> BasicObj& weld(Vec3<T> a, const Color* c = nullptr) {
+        WeldKey key = weld_key(3, a.x, a.y, a.z, c);
+        auto found = welded_vertices.try_emplace(key, 0);
+        if (found.second) {
+            c ? vertex3(a, *c) : vertex3(a);
+            found.first->second = v_count;
+        }
+        element_vertices.push_back(found.first->second);
+        return *this;
+    }
+
+    template <typename T> BasicObj& weld_normal(Vec3<T> n) {
+        WeldKey key = weld_key(3, n.x, n.y, n.z, nullptr);
+        auto found = welded_normals.try_emplace(key, 0);
+        if (found.second) {
+            normal3(n);
+            found.first->second = vn_count;
+        }
+        element_normals.push_back(found.first->second);
+        return *this;
+    }
+
+    // Write a point ('p'), polyline ('l') or polygon ('f') element referencing the welded vertices, and normals if
+    // there are any, and then start a new element
+    BasicObj& welded_element(char directive, bool closed = false) {
+        directive == 'p' ? p() : directive == 'l' ? l() : f();
+        bool normals = !element_normals.empty();
+        size_t count = element_vertices.size();
+        for (size_t i = 0; i < count + (closed ? 1 : 0); i++) {
+            insert(welded_index(element_vertices[i % count], v_count));
+            if (normals) add("//").add(welded_index(element_normals[i % count], vn_count));
+        }
+        element_vertices.clear();
+        element_normals.clear();
+        return *this;
+    }
+
+    // Convert a 1-based index to the index to write
+    int welded_index(unsigned index, unsigned count) const {
+        return negative_indices() ? static_cast<int>(index) - static_cast<int>(count) - 1 : static_cast<int>(index);
+    }
+
+    // Key for exact comparisons of welded vertex data, this compares the bits of the coordinates so e.g., 0 and -0 are
+    // different, since they are written differently
+    template <typename T> static WeldKey weld_key(int dimension, T x, T y, T z, const Color* c) {
+        WeldKey key;
+        double xyz[3] = {static_cast<double>(x), static_cast<double>(y), static_cast<double>(z)};
+        std::memcpy(key.bits, xyz, sizeof(xyz));
+        key.bits[3] = static_cast<uint64_t>(dimension);
+        if (c) key.bits[3] |= 1u << 8 | uint64_t(c->r) << 16 | uint64_t(c->g) << 24 | uint64_t(c->b) << 32;
+        return key;
+    }
+
+    // Account for the vertex data appended from another Obj, so positive and welded indices stay correct
+    void add_counts(const BasicObj& other) {
+        v_count += other.v_count;
+        vn_count += other.vn_count;
+        vt_count += other.vt_count;
+        dropped_count += other.dropped_count;
+    }
+
+    // Return the precision/indexing mode, these are constants if the Policy is a StaticPolicy
+    constexpr int digits() const {
+        if constexpr (Policy::is_static) return Policy::precision;
+        else return precision;
+    }
+
+    constexpr bool negative_indices() const {
+        if constexpr (Policy::is_static) return Policy::use_negative_indices;
+        else return use_negative_indices;
+    }
+
+    static constexpr int default_precision() {
+        if constexpr (Policy::is_static) return Policy::precision;
+        else return std::numeric_limits<double>::max_digits10;
+    }
+
+    static constexpr bool default_use_negative_indices() {
+        if constexpr (Policy::is_static) return Policy::use_negative_indices;
+        else return true;
+    }
+
+    // Return the v-directive index to use
+    int v_index(int i) {
+        // @TODO Could ensure i and v_count are consistent here to catch errors! Prizm does a good job of catching errors anyway so maybe this is not needed---but need to confirm Prizm catches this particular error
+        return (i > 0 || negative_indices()) ? i : v_count + 1 + i;
+    }
+
+    // Return the vn-directive index to use
+    int vn_index(int i) {
+        return (i > 0 || negative_indices()) ? i : vn_count + 1 + i;
+    }
+
+    // Return the vt-directive index to use
+    int vt_index(int i) {
+        return (i > 0 || negative_indices()) ? i : vt_count + 1 + i;
+    }
+
+
+
+
+    //
+    // User-provided extension methods
+    //
+
+#ifdef PRIZM_OBJ_CLASS_EXTRA
+    PRIZM_OBJ_CLASS_EXTRA
+#endif
+};
+
+#endif // PRIZM_DISABLE
+
+
+//
+// Collects Objs written concurrently by many threads, e.g., by the workers of a thread pool, and merges them into a
+// single Obj. Each thread writes to its own shard so the only synchronization is a lock-free registration the first
+// time a thread calls local(), after that writing has no contention. Calling merge() or write() while other threads
+// are writing is an error.
+//
+// The merged output is ordered by the `key` passed to local(key), pieces with equal keys are ordered by thread (in the
+// order threads first called local) and then in the order they were started. Pass e.g., a worker index or a sequence
+// number as the key if you need the output to be identical between runs.
+//
+// Note: The merge uses Prizm::Obj::append, so you must only use negative (aka relative) indices
+//
+#ifdef PRIZM_DISABLE
+struct ShardedObj {
+    Obj& local(uint64_t = 0) {
+        static Obj obj; // Stateless, so sharing it between threads is fine
+        return obj;
+    }
+    Obj merge() const { return {}; }
+    void write(const std::string&) const {}
+    void clear() {}
+};
+#else
+struct ShardedObj {
+
+    // A piece of output started by local(key)
+    struct Piece {
+        uint64_t key = 0;
+        Obj obj;
+    };
+
+    // The pieces written by one thread
+    struct Shard {
+        std::thread::id thread;
+        uint64_t registration = 0; // Order in which the thread first called local()
+        std::deque<Piece> pieces; // A deque so references returned by local() stay valid as pieces are added
+        Shard* next = nullptr;
+    };
+
+    // Lock-free list of shards, new shards are pushed at the head
+    std::atomic<Shard*> shards{nullptr};
+
+    // Number of shards registered so far
+    std::atomic<uint64_t> shard_count{0};
+
+    // Distinguishes this ShardedObj from others in the thread-local shard cache, see local_shard()
+    uint64_t id = next_id();
+
+    // Precision used by the Obj of every new piece, see Obj::set_precision
+    int precision = std::numeric_limits<double>::max_digits10;
+
+    ShardedObj() {}
+    ShardedObj(const ShardedObj&) = delete;
+    ShardedObj& operator=(const ShardedObj&) = delete;
+
+    ~ShardedObj() {
+        clear();
+    }
+
+    // Returns the Obj that the calling thread is currently writing to, starting a piece with key 0 if there is none
+    Obj& local() {
+        Shard* shard = local_shard();
+        if (shard->pieces.empty()) {
+            return local(0);
+        }
+        return shard->pieces.back().obj;
+    }
+
+    // Starts a new piece of the calling thread's output, which will be merged in order of `key`, and returns its Obj
+    Obj& local(uint64_t key) {
+        Shard* shard = local_shard();
+        shard->pieces.emplace_back();
+        Piece& piece = shard->pieces.back();
+        piece.key = key;
+        piece.obj.set_precision(precision);
+        return piece.obj;
+    }
+
+    // Concatenate all the pieces written so far, see the ordering rules described above
+    Obj merge() const {
+        std::vector<const Shard*> ordered;
+        for (const Shard* shard = shards.load(std::memory_order_acquire); shard; shard = shard->next) {
+            ordered.push_back(shard);
+        }
+        std::sort(ordered.begin(), ordered.end(), [](const Shard* a, const Shard* b) {
+            return a->registration < b->registration;
+        });
+
+        std::vector<const Piece*> pieces;
+        for (const Shard* shard : ordered) {
+            for (const Piece& piece : shard->pieces) {
+                pieces.push_back(&piece);
+            }
+        }
+        std::stable_sort(pieces.begin(), pieces.end(), [](const Piece* a, const Piece* b) {
+            return a->key < b->key;
+        });
+
+        Obj result;
+        for (const Piece* piece : pieces) {
+            result.append(piece->obj);
+        }
+        return result;
+    }
+
+    // Merge the pieces and write them to a file, see Prizm::Obj::write
+    void write(const std::string& filename) const {
+        merge().write(filename);
+    }
+
+    // Remove all shards. Like merge() this must not be called while other threads are writing
+    void clear() {
+        Shard* shard = shards.exchange(nullptr);
+        while (shard) {
+            Shard* next = shard->next;
+            delete shard;
+            shard = next;
+        }
+        shard_count = 0;
+        id = next_id(); // Invalidate the thread-local caches
+    }
+
+    //
+    // Implementation methods
+    //
+
+    // Returns the calling thread's shard, registering it if this is the first call on this thread
+    Shard* local_shard() {
+        // Cache the most recently used shard, so threads writing to a single ShardedObj only search the list once
+        thread_local uint64_t cached_id = 0;
+        thread_local Shard* cached_shard = nullptr;
+        if (cached_id == id) {
+            return cached_shard;
+        }
+
+        std::thread::id self = std::this_thread::get_id();
+        Shard* head = shards.load(std::memory_order_acquire);
+        for (Shard* shard = head; shard; shard = shard->next) {
+            if (shard->thread == self) {
+                cached_id = id;
+                cached_shard = shard;
+                return shard;
+            }
+        }
+
+        // Only this thread adds shards for itself, so there is no need to search again if the push below fails
+        Shard* shard = new Shard;
+        shard->thread = self;
+        shard->registration = shard_count.fetch_add(1);
+        shard->next = head;
+        while (!shards.compare_exchange_weak(shard->next, shard, std::memory_order_release, std::memory_order_relaxed)) {}
+
+        cached_id = id;
+        cached_shard = shard;
+        return shard;
+    }
+
+    static uint64_t next_id() {
+        static std::atomic<uint64_t> counter{0};
+        return ++counter;
+    }
+};
+#endif // PRIZM_DISABLE
+
+
+//
+// Writes Objs to files on a dedicated I/O thread so that the calling thread does not stall on disk, this is useful
+// when you write a file per iteration of an algorithm. The buffers of queued Objs are moved, not copied. If the queued
+// Objs hold more than `max_queued_bytes` then write_async blocks until the I/O thread catches up, so memory use stays
+// bounded even if your program produces output faster than the disk can absorb it.
+//
+// Note: The destructor waits for all queued files to be written
+//
+#ifdef PRIZM_DISABLE
+struct AsyncWriter {
+    explicit AsyncWriter(size_t = 0) {}
+    template <typename String> void write_async(Obj&&, const String&) {}
+    void wait() {}
+};
+#else
+struct AsyncWriter {
+
+    struct Job {
+        Obj obj;
+        std::string filename;
+    };
+
+    std::mutex mutex;
+    std::condition_variable job_added; // Signalled when a job is queued or when stopping
+    std::condition_variable job_done; // Signalled when a job is written
+    std::deque<Job> jobs;
+    size_t queued_bytes = 0; // Total size of the Objs in `jobs` and the Obj being written
+    size_t max_queued_bytes = 0;
+    bool writing = false; // True while the I/O thread is writing a job which has been removed from `jobs`
+    bool stopping = false;
+    std::thread thread;
+
+    explicit AsyncWriter(size_t max_queued_bytes = size_t(256) << 20) : max_queued_bytes(max_queued_bytes) {
+        thread = std::thread([this]() { run(); });
+    }
+
+    AsyncWriter(const AsyncWriter&) = delete;
+    AsyncWriter& operator=(const AsyncWriter&) = delete;
+
+    ~AsyncWriter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        job_added.notify_one();
+        thread.join();
+    }
+
+    // Queue `obj` to be written to `filename`, see Prizm::Obj::write. Blocks while the queue is full, unless the queue
+    // is empty, so a single Obj larger than `max_queued_bytes` can still be written
+    void write_async(Obj&& obj, std::string filename) {
+        size_t bytes = obj.size();
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            job_done.wait(lock, [&]() {
+                return queued_bytes == 0 || queued_bytes + bytes <= max_queued_bytes;
+            });
+            jobs.push_back(Job{std::move(obj), std::move(filename)});
+            queued_bytes += bytes;
+        }
+        job_added.notify_one();
+    }
+
+    // Block until every queued Obj has been written
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        job_done.wait(lock, [&]() {
+            return jobs.empty() && !writing;
+        });
+    }
+
+    //
+    // Implementation methods
+    //
+
+    // The I/O thread loop
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            job_added.wait(lock, [&]() {
+                return stopping || !jobs.empty();
+            });
+            if (jobs.empty()) {
+                return; // Only stop when all the queued jobs are written
+            }
+
+            Job job = std::move(jobs.front());
+            jobs.pop_front();
+            writing = true;
+
+            lock.unlock();
+            job.obj.write(job.filename);
+            size_t bytes = job.obj.size();
+            job = Job{}; // Free the buffer before we report that there is space in the queue
+            lock.lock();
+
+            queued_bytes -= bytes;
+            writing = false;
+            job_done.notify_all();
+        }
+    }
+};
+#endif // PRIZM_DISABLE
+
+//
+// Keeps the most recent Obj snapshots in memory and writes them to files only when something goes wrong, so you get
+// post-mortem geometry without paying for I/O on every iteration. The snapshots are copied into a ring buffer which
+// is allocated up front, recording a snapshot evicts the oldest ones until at most `max_snapshots` snapshots using at
+// most `max_bytes` bytes are kept. Snapshots larger than `max_bytes` are dropped, so if `max_snapshots` or `max_bytes`
+// is zero every snapshot is dropped.
+//
+// The snapshots are written to `path_prefix` followed by the snapshot number and ".obj" when you call dump(), and also
+// when the program receives a fatal signal, if you called install_signal_handlers(). Note a failed assert calls
+// abort, which raises SIGABRT, so failed assertions also dump the snapshots. The signal handler only uses
+// async-signal-safe functions, and it can run while record() is interrupted since snapshots are evicted before their
+// bytes are overwritten.
+//
+#ifdef PRIZM_DISABLE
+struct FlightRecorder {
+    explicit FlightRecorder(const std::string&, size_t = 0, size_t = 0) {}
+    void record(const Obj&) {}
+    size_t dump() { return 0; }
+    void install_signal_handlers() {}
+    void uninstall_signal_handlers() {}
+    size_t snapshot_count() const { return 0; }
+    std::string snapshot(size_t) const { return {}; }
+};
+#else
+struct FlightRecorder {
+
+    // A recorded Obj, `begin` is the position of its first byte in the stream of all the bytes recorded so far
+    struct Snapshot {
+        uint64_t number = 0;
+        uint64_t begin = 0;
+        size_t count = 0;
+    };
+
+    std::vector<char> ring;
+    std::vector<Snapshot> snapshots; // Also used as a ring, snapshot i is stored at index i % snapshots.size()
+    std::atomic<uint64_t> first{0}; // Index of the oldest snapshot kept
+    std::atomic<uint64_t> last{0}; // One past the index of the newest snapshot kept
+    uint64_t end = 0; // Position in the stream of recorded bytes where the next snapshot will begin
+    uint64_t recorded_count = 0; // Number of calls to record(), used to number the snapshots
+    uint64_t dropped_count = 0; // Number of snapshots which were too large to be kept
+    std::vector<char> path; // `path_prefix` with space to append a snapshot number and ".obj"
+    size_t path_prefix_size = 0;
+    std::mutex mutex; // Serializes record() and dump(), the signal handler does not lock it
+
+    explicit FlightRecorder(const std::string& path_prefix, size_t max_snapshots = 16, size_t max_bytes = size_t(64) << 20)
+        : ring(max_bytes), snapshots(max_snapshots), path(path_prefix.size() + 32), path_prefix_size(path_prefix.size())
+    {
+        std::memcpy(path.data(), path_prefix.data(), path_prefix.size());
+    }
+
+    FlightRecorder(const FlightRecorder&) = delete;
+    FlightRecorder& operator=(const FlightRecorder&) = delete;
+
+    ~FlightRecorder() {
+        uninstall_signal_handlers();
+    }
+
+    // Copy the current contents of `obj` into the ring buffer
+    void record(const Obj& obj) {
+        std::lock_guard<std::mutex> lock(mutex);
+        uint64_t number = recorded_count++;
+        size_t count = obj.size();
+        if (snapshots.empty() || ring.empty() || count > ring.size()) {
+            dropped_count++;
+            return;
+        }
+
+        // Evict before overwriting, so a signal handler interrupting us only sees complete snapshots
+        uint64_t keep = first.load(std::memory_order_relaxed);
+        uint64_t stop = last.load(std::memory_order_relaxed);
+        while (keep < stop && (stop - keep == snapshots.size() || end + count - slot(keep).begin > ring.size())) {
+            keep++;
+        }
+        first.store(keep, std::memory_order_release);
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+
+        uint64_t position = end;
+        obj.for_each_piece([this, &position](const char* data, size_t piece_count) {
+            size_t offset = static_cast<size_t>(position % ring.size());
+            size_t head = std::min(piece_count, ring.size() - offset);
+            std::memcpy(ring.data() + offset, data, head);
+            std::memcpy(ring.data(), data + head, piece_count - head);
+            position += piece_count;
+        });
+
+        Snapshot& snapshot = slot(stop);
+        snapshot.number = number;
+        snapshot.begin = end;
+        snapshot.count = count;
+        end += count;
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        last.store(stop + 1, std::memory_order_release);
+    }
+
+    // Write the snapshots to files, see the comment above this struct. Returns the number of files written
+    size_t dump() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return dump_signal_safe();
+    }
+
+    // Dump the snapshots if the program receives a fatal signal. Only one FlightRecorder can be installed at a time,
+    // installing another one replaces this one
+    void install_signal_handlers() {
+        installed().store(this);
+        for (int signal : fatal_signals()) {
+#ifdef _WIN32
+            std::signal(signal, handle_signal);
+#else
+            // SA_RESETHAND restores the default action before the handler runs, so a second fatal signal raised while
+            // dumping terminates the program rather than re-entering the handler
+            struct sigaction action = {};
+            action.sa_handler = handle_signal;
+            action.sa_flags = SA_RESETHAND;
+            sigemptyset(&action.sa_mask);
+            sigaction(signal, &action, nullptr);
+#endif
+        }
+    }
+
+    void uninstall_signal_handlers() {
+        FlightRecorder* self = this;
+        if (installed().compare_exchange_strong(self, nullptr)) {
+            for (int signal : fatal_signals()) {
+#ifdef _WIN32
+                std::signal(signal, SIG_DFL);
+#else
+                struct sigaction action = {};
+                action.sa_handler = SIG_DFL;
+                sigemptyset(&action.sa_mask);
+                sigaction(signal, &action, nullptr);
+#endif
+            }
+        }
+    }
+
+    // Number of snapshots currently kept
+    size_t snapshot_count() const {
+        return static_cast<size_t>(last - first);
+    }
+
+    // Returns the text of the i-th snapshot kept, the oldest snapshot is at index 0
+    std::string snapshot(size_t i) const {
+        const Snapshot& s = slot(first + i);
+        std::string text(s.count, '\0');
+        size_t offset = static_cast<size_t>(s.begin % ring.size());
+        size_t head = std::min(s.count, ring.size() - offset);
+        std::memcpy(&text[0], ring.data() + offset, head);
+        std::memcpy(&text[0] + head, ring.data(), s.count - head);
+        return text;
+    }
+
+    //
+    // Implementation methods
+    //
+
+    Snapshot& slot(uint64_t i) {
+        return snapshots[static_cast<size_t>(i % snapshots.size())];
+    }
+
+    const Snapshot& slot(uint64_t i) const {
+        return snapshots[static_cast<size_t>(i % snapshots.size())];
+    }
+
+    // Write the snapshots using only async-signal-safe functions i.e., no allocation, locking or stdio
+    size_t dump_signal_safe() {
+        size_t written = 0;
+        uint64_t stop = last.load(std::memory_order_acquire);
+        for (uint64_t i = first.load(std::memory_order_acquire); i < stop; i++) {
+            const Snapshot& s = slot(i);
+            char* name_end = std::to_chars(path.data() + path_prefix_size, path.data() + path.size() - 5, s.number).ptr;
+            std::memcpy(name_end, ".obj", 5);
+
+            size_t offset = static_cast<size_t>(s.begin % ring.size());
+            size_t head = std::min(s.count, ring.size() - offset);
+            if (write_file(path.data(), ring.data() + offset, head, ring.data(), s.count - head)) {
+                written++;
+            }
+        }
+        return written;
+    }
+
+    static bool write_file(const char* filename, const char* a, size_t a_count, const char* b, size_t b_count) {
+#ifdef _WIN32
+        int fd = _open(filename, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+        int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+        if (fd < 0) {
+            return false;
+        }
+        bool ok = write_all(fd, a, a_count) && write_all(fd, b, b_count);
+#ifdef _WIN32
+        _close(fd);
+#else
+        close(fd);
+#endif
+        return ok;
+    }
+
+    static bool write_all(int fd, const char* bytes, size_t count) {
+        while (count > 0) {
+#ifdef _WIN32
+            int n = _write(fd, bytes, static_cast<unsigned>(std::min(count, size_t(1) << 30)));
+#else
+            ssize_t n = write(fd, bytes, count);
+#endif
+            if (n <= 0) {
+                return false;
+            }
+            bytes += n;
+            count -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    static std::vector<int> fatal_signals() {
+        return {SIGSEGV, SIGABRT, SIGFPE, SIGILL};
+    }
+
+    static std::atomic<FlightRecorder*>& installed() {
+        static std::atomic<FlightRecorder*> recorder{nullptr};
+        return recorder;
+    }
+
+    // Dump the installed recorder then re-raise the signal with the default handler, so the program still terminates
+    // (and e.g., writes a core dump) as it would have done without the recorder. On POSIX the default handler was
+    // already restored by SA_RESETHAND
+    static void handle_signal(int signal) {
+        if (FlightRecorder* recorder = installed().load()) {
+            recorder->dump_signal_safe();
+        }
+#ifdef _WIN32
+        std::signal(signal, SIG_DFL);
+#endif
+        std::raise(signal);
+    }
+};
+#endif // PRIZM_DISABLE
+
+//
+// Appends Objs as the frames of a single ".prizmf" container file, which the viewer opens as one item with a frame
+// slider, loading only the frame being shown. Use this instead of writing a numbered file per iteration when you have
+// many iterations. Each frame is flushed to disk when it is added, and the viewer (and read_frames) can read the
+// frames of a container whose writer crashed before writing the frame index.
+//
+// The layout, all integers are little-endian:
+//   "PRIZMFRM", u32 version 1, u32 zero
+//   For each frame: u64 byte count, then the OBJ text of the frame
+//   The frame index, written by close(): u64 file offset of each frame, u64 frame count, u64 file offset of the index,
+//   then "PRIZMIDX"
+//
+// Note: The destructor calls close()
+//
+#ifdef PRIZM_DISABLE
+struct FrameWriter {
+    explicit FrameWriter(const std::string&) {}
+    void add(const Obj&) {}
+    size_t frame_count() const { return 0; }
+    void close() {}
+};
+#else
+struct FrameWriter {
+
+    std::ofstream file;
+    std::vector<uint64_t> offsets; // File offset of each frame
+    uint64_t end = 16; // File offset where the next frame will be written
+
+    explicit FrameWriter(const std::string& filename) : file(filename, std::ofstream::binary) {
+        file.write("PRIZMFRM", 8);
+        write_u32(1);
+        write_u32(0);
+        file.flush();
+    }
+
+    FrameWriter(const FrameWriter&) = delete;
+    FrameWriter& operator=(const FrameWriter&) = delete;
+
+    ~FrameWriter() {
+        close();
+    }
+
+    // Append the current contents of `obj` as the next frame
+    void add(const Obj& obj) {
+        if (!file.is_open()) {
+            return;
+        }
+        std::string annotation = obj.budget_annotation();
+        uint64_t count = obj.size() + annotation.size();
+        offsets.push_back(end);
+        write_u64(count);
+        obj.for_each_piece([this](const char* data, size_t piece_count) { file.write(data, piece_count); });
+        file.write(annotation.data(), annotation.size());
+        file.flush();
+        end += 8 + count;
+    }
+
+    size_t frame_count() const {
+        return offsets.size();
+    }
+
+    // Write the frame index and close the file, no frames can be added afterwards
+    void close() {
+        if (!file.is_open()) {
+            return;
+        }
+        for (uint64_t offset : offsets) {
+            write_u64(offset);
+        }
+        write_u64(offsets.size());
+        write_u64(end);
+        file.write("PRIZMIDX", 8);
+        file.close();
+    }
+
+    //
+    // Implementation methods
+    //
+
+    void write_u32(uint32_t value) {
+        char bytes[4];
+        for (int i = 0; i < 4; i++) bytes[i] = static_cast<char>(value >> (8 * i));
+        file.write(bytes, 4);
+    }
+
+    void write_u64(uint64_t value) {
+        char bytes[8];
+        for (int i = 0; i < 8; i++) bytes[i] = static_cast<char>(value >> (8 * i));
+        file.write(bytes, 8);
+    }
+};
+#endif // PRIZM_DISABLE
+
+//
+// Writes the frames of an iterative algorithm, e.g., a smoothing loop which moves the vertices of the same mesh every
+// iteration, as one full base file followed by small delta files. Each delta only lists the vertices which changed
+// since the previous frame, and the elements which were added or removed, so the connectivity is not repeated in
+// every file. Load the base file in the viewer, then load the deltas in order (e.g., by dropping them on the viewer or
+// letting it watch the directory) and each one patches the base item in place, see obj_delta for the format.
+//
+// The first call to write() writes the base file using Obj::write, so e.g., a base filename ending with ".obj.lz4" is
+// compressed, and later calls write a delta to e.g., "smooth.0001.prizmd" for the base file "smooth.obj". Deltas are
+// found by comparing the meshes the viewer builds from the frames, annotations, normals, prototypes and instances are
+// not included in the deltas, so use separate files for frames where those change. Requires PRIZM_API_IMPLEMENTATION in
+// one translation unit
+//
+#ifdef PRIZM_DISABLE
+struct DeltaWriter {
+    explicit DeltaWriter(const std::string&) {}
+    std::string write(Obj&) { return {}; }
+};
+#else
+struct DeltaWriter {
+
+    std::string base_filename;
+    Shards names; // Used to name the deltas, the i-th delta is written to stem.i.prizmd
+    PrizmbMesh previous; // The mesh of the previous frame, so each frame is only parsed once
+    uint64_t sequence = 0; // Number of the next delta, zero if the base file has not been written
+
+    explicit DeltaWriter(const std::string& base_filename) : base_filename(base_filename) {
+        names.set_filename(base_filename);
+        names.suffix = ".prizmd";
+    }
+
+    // Write `obj` as the next frame, returns the name of the file written
+    std::string write(Obj& obj) {
+        PrizmbMesh mesh = prizmb_mesh_from_obj(obj.to_std_string());
+        std::string filename;
+        if (sequence == 0) {
+            filename = base_filename;
+            obj.write(filename);
+        } else {
+            filename = names.filename(static_cast<int>(sequence));
+            std::string base_name = base_filename.substr(base_filename.find_last_of("/\\") + 1);
+            std::string delta = obj_delta(previous, mesh, base_name, sequence);
+            std::ofstream file(filename, std::ofstream::binary);
+            file.write(delta.data(), delta.size());
+        }
+        std::swap(previous, mesh);
+        sequence++;
+        return filename;
+    }
+};
+#endif // PRIZM_DISABLE
+
+
+//
+// Keeps a uniform random sample of at most `sample_count` elements from a stream of elements too long to write in
+// full (reservoir sampling). Call next() before writing each element, it returns the Obj to write the element to, or
+// nullptr if the element is not sampled, in which case the cost of the call is a counter increment and comparison:
+//
+//     if (Obj* obj = sampled.next()) obj->segment3(a, b).annotation("step").insert(step);
+//
+// merge() concatenates the sampled elements in the order they were passed to next() and adds an annotation with the
+// number of elements which were not sampled. Each element must be written to a separate Obj using negative indices
+// (the default), so don't use welding mode. See also Obj::set_sample_every and the other Obj budgets.
+//
+#ifdef PRIZM_DISABLE
+struct SampledObj {
+    explicit SampledObj(int, uint64_t = 0) {}
+    Obj* next() { return nullptr; }
+    Obj merge() const { return {}; }
+    void write(const std::string&) const {}
+};
+#else
+struct SampledObj {
+
+    struct Sample {
+        uint64_t index = 0; // Position of the element in the stream
+        Obj obj;
+    };
+
+    std::vector<Sample> samples;
+    size_t sample_count = 0;
+    uint64_t seen_count = 0; // Number of calls to next()
+    uint64_t next_index = 0; // Index of the next element which will be sampled, once the reservoir is full
+    double w = 0; // The state of Algorithm L (Li, 1994), which computes next_index without a random draw per element
+    uint64_t random_state = 0;
+
+    explicit SampledObj(int sample_count, uint64_t seed = 0)
+        : sample_count(sample_count > 0 ? sample_count : 0), random_state(seed)
+    {
+        samples.reserve(this->sample_count);
+        w = std::exp(std::log(random()) / this->sample_count);
+        next_index = this->sample_count + skip_count();
+    }
+
+    SampledObj(const SampledObj&) = delete;
+    SampledObj& operator=(const SampledObj&) = delete;
+
+    // Returns the Obj to write the next element to, or nullptr if it is not sampled
+    Obj* next() {
+        uint64_t index = seen_count++;
+        if (index < sample_count) {
+            samples.push_back(Sample{index, Obj()});
+            return &samples.back().obj;
+        }
+        if (index != next_index) {
+            return nullptr;
+        }
+
+        Sample& sample = samples[static_cast<size_t>(random_below(sample_count))];
+        sample.index = index;
+        sample.obj = Obj();
+        w *= std::exp(std::log(random()) / sample_count);
+        next_index += 1 + skip_count();
+        return &sample.obj;
+    }
+
+    // Concatenate the sampled elements, see the comment above this struct
+    Obj merge() const {
+        std::vector<const Sample*> ordered;
+        for (const Sample& sample : samples) {
+            ordered.push_back(&sample);
+        }
+        std::sort(ordered.begin(), ordered.end(), [](const Sample* a, const Sample* b) {
+            return a->index < b->index;
+        });
+
+        Obj result;
+        for (const Sample* sample : ordered) {
+            result.append(sample->obj);
+        }
+        if (seen_count > samples.size()) {
+            result.newline().add("# Sampled ").add(samples.size()).add(" of ").add(seen_count).add(" elements");
+        }
+        return result;
+    }
+
+    // Merge the samples and write them to a file, see Prizm::Obj::write
+    void write(const std::string& filename) const {
+        merge().write(filename);
+    }
+
+    //
+    // Implementation methods
+    //
+
+    // Number of elements to skip before the next sampled one
+    uint64_t skip_count() {
+        if (sample_count == 0) return std::numeric_limits<uint64_t>::max() / 2;
+        double skip = std::floor(std::log(random()) / std::log1p(-w));
+        return skip < 1e18 ? static_cast<uint64_t>(skip) : uint64_t(1e18);
+    }
+
+    // Returns a number in (0, 1], generated using splitmix64 so the sample only depends on the seed
+    double random() {
+        uint64_t z = (random_state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        z ^= z >> 31;
+        return static_cast<double>((z >> 11) + 1) * 0x1.0p-53;
+    }
+
+    uint64_t random_below(uint64_t n) {
+        uint64_t i = static_cast<uint64_t>(random() * static_cast<double>(n));
+        return i < n ? i : n - 1;
+    }
+};
+#endif // PRIZM_DISABLE
+
+
+#ifdef PRIZM_DISABLE
+bool documentation(bool) {
+    return true; // There is nothing to test if Prizm is compiled out
+}
+#else
+bool documentation(bool write_files) {
+
+    // This `documentation` function is also used a test, hence this function
+    bool tests_pass = true;
+    auto test = [&write_files](std::string filename, std::string got, std::string wanted) {
+        bool passed = true;
+        if (wanted == got) {
+            std::cout << "Test  " << filename << " PASSED..." << std::endl;
+        } else {
+            std::cout << "Test  " << filename << " FAILED..." << std::endl;
+            std::cout << "Wanted:" << wanted << "\nGot:" << got << std::endl;
+            passed = false;
+        }
+        if (!passed || write_files) {
+            std::ofstream file;
+            file.open(filename, std::ofstream::out | std::ofstream::trunc);
+            file << got;
+            file.close();
+            std::cout << "Wrote " << filename << std::endl;
+        }
+        return passed;
+    };
+
+
+
+
+    // This block illustrates most of the API
+    {
+        // Access Obj struct and typedefs. This isn't strictly necessary here but its likely you'll want it in user code
+        using namespace Prizm;
+
+        Obj obj;
+
+        // First we'll add a comment at the top of the file. If you look at the `output` string below you can see that
+        // the provided text is prefixed by ## in the obj file, the obj spec uses a # to start a comment.
+        obj.comment("This file tests the Prizm C++ API");
+
+        // Now we'll write 3 vertices and a triangle element in a very verbose way. Note that most functions in the
+        // `Obj` API return `Obj&` which allows you to chain calls which can be handy if you like your debugging code
+        // to be concise
+        obj.vertex3(V3{0., 0., 1.}).annotation("Vertex A");
+        obj.vertex3(V3{3., 0., 1.}).annotation("Vertex B");
+        obj.vertex3(V3{3., 3., 1.}).annotation("Vertex C");
+        obj.triangle().annotation("Triangle ABC");
+
+        // The previous block had a lot of typing... you can do something similar (without the vertex annotations) as a
+        // one-liner like this:
+        obj.triangle3(V3{0., 0., 2.}, V3{3., 0., 2.}, V3{3., 3., 2.}).annotation("Triangle ABC");
+
+        // The triangle element and vertex positions we just added to the obj all have _Annotation_ strings associated
+        // with them. These strings can be visualized in Prizm by turning on annotation labelling.  The annotations are
+        // written to the obj file using obj comment syntax which means that adding them doesn't prevent the geometry
+        // loading in a different obj viewer (but, of course, in a different viewer you won't be able to see the
+        // annotations). Note we need to use the verbose version we want to annotate the vertices.
+
+        // The Obj class will have a bunch of functions for writing compound shapes for now polylines, polygons and
+        // boxes are supported but more will be added. To demo these functions we'll use the following data which
+        // represents a 2D star shape; we use a union so we can illustrate different APIs.
+        union {
+            double coords[8*2] = {
+                2, 2,   10, 0,   2, -2,   0, -10,   -2, -2,   -10, 0,   -2, 2,   0, 10
+            };
+            struct {
+                V2 a, b, c, d, e, f, g, h;
+            } points;
+        } star;
+
+        // First we'll write the star as a polyline boundary using a pointer-to-coordinate-buffer API:
+        obj.polyline2(8, star.coords, true).annotation("star boundary");
+
+        // Next, we'll write the star as a polygon using a variadic function call, a similar variadic function also
+        // exists for writing polyline2 geometry
+        obj.polygon2(8,
+            star.points.a,
+            star.points.b,
+            star.points.c,
+            star.points.d,
+            star.points.e,
+            star.points.f,
+            star.points.g,
+            star.points.h).annotation("star polygon");
+
+        // The previous line wrote the coordinate data again even though we wrote it when we called polyline2, this
+        // is probably fine for debugging code but, just to illustrate another function, we can write only an obj
+        // f-directive references the previous vertices as follows:
+        obj.polygon(8).annotation("star polygon again");
+
+        // Note the obj spec allows you to reference previous vertices by using negative indices.  This feature is
+        // pretty handy for not having to track the current vertex index and also for enabling you to concatenate obj
+        // files into a single jumbo file, which we'll illustrate later.  One downside of using this feature is that
+        // it appears not to be well supported by other viewers so in a future update of this API we'll add a function
+        // to convert files into some well-supported subset of the spec e.g., by converting negative indices into
+        // positive ones and converting l-/f-directives with more than 2/3 indices on a single line into a list of
+        // l-/f-directives with exactly 2/3 indices on each line.
+
+        // In general functions ending with a number have 2D/3D vector arguments and write both v-directives and the
+        // relevant element directives. If you want to just write the element directive you can use the functions with
+        // no number postfix. Note for some functions the number indicating dimension is redundant but we write it
+        // anyway for consistency.
+
+        // Here we write a bounding box for the star we just logged:
+        constexpr double inf = std::numeric_limits<double>::infinity();
+        V2 star_min{inf, inf}, star_max{-inf, -inf};
+        for (int i = 0; i < 8; i++) {
+            double x = star.coords[2*i + 0], y = star.coords[2*i + 1];
+            star_max.x = std::max(star_max.x , x);
+            star_min.x = std::min(star_min.x , x);
+            star_max.y = std::max(star_max.y , y);
+            star_min.y = std::min(star_min.y , y);
+        }
+        obj.box2_min_max(star_min, star_max).annotation("star bounding box");
+
+        // So far we've only had one annotation per geometric entity (vertex/element), this is because Prizm
+        // represents annotations with a single string and there are no plans to change this. If you call the
+        // annotation function more than once per line each call concatenates into a single annotation string
+        obj.point2(V2{4., 7.}).annotation("these").annotation("are").annotation("concatenated");
+
+        // In some cases it can be useful attach more one or pieces of typed numerical data to the each geometric
+        // entity of a mesh e.g., a scalar cost of a triangle edge collapse or a vertex displacement in a finite
+        // element mesh.  A future version of Prizm will support this by adding _Attributes_ to its internal mesh
+        // datastructure along with UI for inspecting and rendering them.  The current plan for attributes is that
+        // they will be set by parsing and extracting data stored in the annotation strings.  This extraction step
+        // will require users to execute a console command explicity or by adding a _Command Annotation_ to the
+        // obj file (command annotations are explained later but they are essentially console commands executed by
+        // the obj file).  In order to facilitate this parsing Prizm will assume attributes are prefixed by an @
+        // and as part of the attribute extraction the relevant portion of the annotation string will be trimmed.
+        // After extraction, the data structure you can inspect in Prizm will have typed attributes as well as
+        // annotations corresponding to the part of the raw in-file annotation strings before the first @.
+        //
+        // Although there is no special rendering/UI for attributes yet (you can only view attributes as the raw
+        // annotation strings) you might still prefer to call the attribute function when adding multiple pieces
+        // of data to a geometric entity because the @'s make the separate data more distinguishable. Here is an
+        // example of point with an annotation and two attributes of different types. Note the attribute function
+        // supports any type which defines an operator<<. Actually, the annotation function in this API also
+        // supports writing non-string data using operator<< but this is just for convenience; rendering/UI support
+        // for annotations in Prizm is built around the assumption that they contain only string data).
+        obj.point2(V2{3., 3.}).annotation("some string").attribute(42).attribute(V2{0.,0.});
+
+        // Add some blank space to clearly separate obj geometry from the command annotations to come.
+        obj.newline(3);
+
+        // Next we'll demonstrate how you can configure how Prizm displays the obj file when it is loaded by writing
+        // command annotations to the obj file.
+        obj.comment("Command Annotations:");
+
+        // Configuring how Prizm displays the obj file is handy because, depending on your debugging use-case, you
+        // will want to see different things.  You could configure the display settings you want by clicking around
+        // in the UI, or by calling the relevant console commands after the file is loaded but this can be slow or
+        // annoying so to save you having to do this manually Prizm's command annotation facility enables you to
+        // execute console commands immediately after the file is loaded.
+        //
+        // For the obj we have been creating so far we are probably only interested in seeing the annotations we added,
+        // so in practice we would probably only want to call the following functions...
+        obj.set_annotations_visible(true);
+        obj.set_annotations_scale(1.);
+        obj.set_annotations_color(BLUE);
+
+        // ...but since we are using this documentation for testing as well we'll just call all the config functions
+        // to verify they are executed with no errors.  First we'll set the precision of the floats we write to the obj
+        // file so that the `output` string looks a bit nicer.
+        obj.set_precision(2);
+        obj.set_vertex_index_labels_visible(false);
         obj.set_vertex_position_labels_visible(false);
         obj.set_vertex_label_color(BLACK);
         obj.set_vertex_label_scale(.4);
@@ -1434,194 +5022,884 @@ bool documentation(bool write_files) {
         obj.set_triangles_visible(true);
         obj.set_triangles_color(GREEN);
 
-        // End the obj with a newline to make the formatting of the `output` string nicer
-        obj.newline();
+        // End the obj with a newline to make the formatting of the `output` string nicer
+        obj.newline();
+
+        // Once we have finished adding to the obj file we can write it out using the `write` function. If we called
+        // this here we would generate a file containing the `output` string.  I personally find using absolute paths
+        // convenient when working in Unreal because I can never remember the directory the Editor is running in.
+        // obj.write("C:/path/to/my/debug/folder/debug_file.obj");
+
+        std::string output = R"DONE(## This file tests the Prizm C++ API
+v 0 0 1 # Vertex A
+v 3 0 1 # Vertex B
+v 3 3 1 # Vertex C
+f -3 -2 -1 # Triangle ABC
+v 0 0 2
+v 3 0 2
+v 3 3 2
+f -3 -2 -1 # Triangle ABC
+v 2 2
+v 10 0
+v 2 -2
+v 0 -10
+v -2 -2
+v -10 0
+v -2 2
+v 0 10
+l -8 -7 -6 -5 -4 -3 -2 -1 -8 # star boundary
+v 2 2
+v 10 0
+v 2 -2
+v 0 -10
+v -2 -2
+v -10 0
+v -2 2
+v 0 10
+f -8 -7 -6 -5 -4 -3 -2 -1 # star polygon
+f -8 -7 -6 -5 -4 -3 -2 -1 # star polygon again
+v -10 -10
+v 10 -10
+v 10 10
+v -10 10
+v -10 -10
+l -5 -4 -3 -2 -1 # star bounding box
+v 4 7
+p -1 # these are concatenated
+v 3 3
+p -1 # some string @ 42 @ 0 0
+
+
+## Command Annotations:
+#! set_annotations_visible 0 1
+#! set_annotations_scale 0 1
+#! set_annotations_color 0 0 0 255 255
+#! set_vertex_index_labels_visible 0 0
+#! set_vertex_position_labels_visible 0 0
+#! set_vertex_label_color 0 0 0 0 255
+#! set_vertex_label_scale 0 0.4
+#! set_vertex_annotations_visible 0 1
+#! set_point_index_labels_visible 0 0
+#! set_point_label_color 0 255 0 0 255
+#! set_point_label_scale 0 0.4
+#! set_point_annotations_visible 0 1
+#! set_segment_index_labels_visible 0 0
+#! set_segment_label_color 0 0 255 0 255
+#! set_segment_label_scale 0 0.4
+#! set_segment_annotations_visible 0 1
+#! set_triangle_index_labels_visible 0 0
+#! set_triangle_label_color 0 0 0 255 255
+#! set_triangle_label_scale 0 0.4
+#! set_triangle_annotations_visible 0 1
+#! set_vertices_visible 0 1
+#! set_vertices_color 0 0 0 255 255
+#! set_vertices_size 0 7
+#! set_points_visible 0 1
+#! set_points_color 0 255 0 0 255
+#! set_points_size 0 3
+#! set_segments_visible 0 1
+#! set_segments_color 0 255 0 0 255
+#! set_segments_width 0 3
+#! set_edges_visible 0 1
+#! set_edges_color 0 0 0 0 255
+#! set_edges_width 0 4
+#! set_triangles_visible 0 1
+#! set_triangles_color 0 0 255 0 255
+)DONE";
+
+        // Since this` documentation` function you are reading is used for testing we actually call the `to_std_string`
+        // function here to generate a string to compare with `output`
+        if (!test("prizm_documentation_ex1.obj", obj.to_std_string(), output)) {
+            tests_pass = false;
+        }
+    }
+
+
+
+
+
+    // This block illustrates how, if you use only relative indexing for point/segment/triangle elements, you can use
+    // the `append` function to concatenate different obj files
+    {
+        // Create the first obj
+        Obj first;
+        first.comment("The first obj:").segment2(V2{0, 0}, V2{1, 0});
+
+        // Create the second obj
+        Obj second;
+        second.comment("The second obj:").point3(V3{1, 2, 3});
+
+        // Concatenate the objs. Use first.append(std::move(second)) if you don't need `second` anymore, this splices its
+        // buffers without copying them which is much faster if you combine many large Objs
+        first.append(second);
+
+        std::string output = R"DONE(## The first obj:
+v 0 0
+v 1 0
+l -2 -1
+## The second obj:
+v 1 2 3
+p -1
+)DONE";
+
+        if (!test("prizm_documentation_ex2.obj", first.to_std_string(), output)) {
+            tests_pass = false;
+        }
+    }
+
+
+    // @TODO Add an example where the append function can be used to add a common footer to multiple obj files (this would be slightly easier than defining a lambda to append it to the given Obj)
+
+
+    // Some obj viewers do not support negative indices so there is an option to use positive indices instead
+    {
+        Obj obj;
+        obj.set_use_negative_indices(false);
+        obj.segment2(V2{0, 0}, V2{1, 0});
+        obj.point3(V3{1, 2, 3});
+
+        std::string output = R"DONE(
+v 0 0
+v 1 0
+l 1 2
+v 1 2 3
+p 3)DONE";
+
+        if (!test("prizm_documentation_ex3.obj", obj.to_std_string(), output)) {
+            tests_pass = false;
+        }
+    }
+
+
+
+
+
+
+    // This block illustrates a possibly handy use-case where you can create and write an obj file in one line
+    {
+        // We don't test this function to keep everything on a single line
+        if (write_files) {
+            std::string filename = "prizm_documentation_ex4.obj";
+            Obj().triangle2(V2{0., 0.}, V2{1., 0.}, V2{1., 1.}).annotation("triangle").point2(V2{3., 3.}).annotation("point").write(filename);
+            std::cout << "Wrote " << filename << std::endl;
+        }
+    }
+
+
+
+
 
-        // Once we have finished adding to the obj file we can write it out using the `write` function. If we called
-        // this here we would generate a file containing the `output` string.  I personally find using absolute paths
-        // convenient when working in Unreal because I can never remember the directory the Editor is running in.
-        // obj.write("C:/path/to/my/debug/folder/debug_file.obj");
 
-        std::string output = R"DONE(## This file tests the Prizm C++ API
-v 0 0 1 # Vertex A
-v 3 0 1 # Vertex B
-v 3 3 1 # Vertex C
-f -3 -2 -1 # Triangle ABC
-v 0 0 2
-v 3 0 2
-v 3 3 2
-f -3 -2 -1 # Triangle ABC
+    // This block illustrates another kinda wacky use-case where you could use the Obj class as a debug file logger
+    // for files which have nothing to do with the obj format
+    {
+        Obj obj;
+        obj.add("some int =").insert(5).newline();
+        obj.add("some type with operator<< =").insert(V2{2, 3}).newline();
+        if (true) {
+            obj.add("condition passed on line").insert(__LINE__);
+            obj.add("\n"); // We don't care about tracking # chars so just log special characters directly
+        }
+
+        // We don't test this function because the __LINE__ macro makes it brittle
+        if (write_files) {
+            std::string filename = "prizm_documentation_ex5.obj";
+            obj.write(filename);
+            std::cout << "Wrote " << filename << std::endl;
+        }
+    }
+
+
+
+
+
+    // By default floating-point numbers are written using the shortest text which round-trips, reducing the precision
+    // switches to %g-style formatting which is handy for annotations
+    {
+        Obj obj;
+        obj.vertex3(V3{0.1, 1e-5, 1./3.}).annotation("third");
+        obj.set_precision(3).attribute(1./3.).set_precision();
+        obj.vertex3(V3f{0.1f, 2.f, 1.f/3.f});
+
+        std::string output = R"DONE(
+v 0.1 1e-05 0.3333333333333333 # third @ 0.333
+v 0.1 2 0.33333334)DONE";
+
+        if (!test("prizm_documentation_ex6.obj", obj.to_std_string(), output)) {
+            tests_pass = false;
+        }
+    }
+
+    // If your mesh is stored in vertex/index buffers you can write it with mesh3, which writes each vertex once
+    {
+        float positions[4*3] = {0,0,0,  1,0,0,  1,1,0,  0,1,0};
+        float normals[4*3] = {0,0,1,  0,0,1,  0,0,1,  0,0,1};
+        unsigned triangles[2*3] = {0,1,2,  0,2,3};
+
+        Obj obj;
+        obj.mesh3(4, positions, 2, triangles, normals).annotation("last triangle");
+        obj.set_use_negative_indices(false);
+        obj.mesh3(4, positions, 2, triangles);
+
+        std::string output = R"DONE(
+v 0 0 0
+v 1 0 0
+v 1 1 0
+v 0 1 0
+vn 0 0 1
+vn 0 0 1
+vn 0 0 1
+vn 0 0 1
+f -4//-4 -3//-3 -2//-2
+f -4//-4 -2//-2 -1//-1 # last triangle
+v 0 0 0
+v 1 0 0
+v 1 1 0
+v 0 1 0
+f 5 6 7
+f 5 7 8)DONE";
+
+        if (!test("prizm_documentation_ex7.obj", obj.to_std_string(), output)) {
+            tests_pass = false;
+        }
+    }
+
+    // If your data has a different memory layout you can use a Strided view to write it without copying
+    {
+        struct Particle { float position[3]; int id; };
+        Particle particles[2] = {{{0, 0, 0}, 7}, {{1, 2, 3}, 8}};
+        double xs[3] = {0, 1, 1}, ys[3] = {0, 0, 1}, zs[3] = {5, 5, 5};
+
+        Obj obj;
+        obj.points3(strided<3>(particles[0].position, 2, sizeof(Particle)));
+        obj.polyline3(strided(xs, ys, zs, 3), true);
+
+        std::string output = R"DONE(
+v 0 0 0
+p -1
+v 1 2 3
+p -1
+v 0 0 5
+v 1 0 5
+v 1 1 5
+l -3 -2 -1 -3)DONE";
+
+        if (!test("prizm_documentation_ex8.obj", obj.to_std_string(), output)) {
+            tests_pass = false;
+        }
+    }
+
+    // If you write Objs from many threads you can use a ShardedObj to collect them without locking
+    {
+        ShardedObj sharded;
+
+        std::vector<std::thread> workers;
+        for (int worker = 0; worker < 4; worker++) {
+            workers.emplace_back([&sharded, worker]() {
+                // Use the worker index as the key so the merged output is the same every time
+                sharded.local(worker).point3(V3(worker, 0, 0)).annotation("worker").insert(worker);
+            });
+        }
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+
+        std::string output = R"DONE(
+
+v 0 0 0
+p -1 # worker 0
+
+
+v 1 0 0
+p -1 # worker 1
+
+
+v 2 0 0
+p -1 # worker 2
+
+
+v 3 0 0
+p -1 # worker 3
+)DONE";
+
+        if (!test("prizm_documentation_ex9.obj", sharded.merge().to_std_string(), output)) {
+            tests_pass = false;
+        }
+    }
+
+    // If your program writes many files you can write them on a background thread with an AsyncWriter
+    {
+        if (write_files) {
+            AsyncWriter writer;
+            for (int i = 0; i < 3; i++) {
+                Obj obj;
+                obj.point2(V2(i, i)).annotation("iteration").insert(i);
+                writer.write_async(std::move(obj), "prizm_documentation_ex10_" + std::to_string(i) + ".obj");
+            }
+            writer.wait();
+
+            std::string filename = "prizm_documentation_ex10_2.obj";
+            std::ifstream file(filename, std::ifstream::binary);
+            std::stringstream got;
+            got << file.rdbuf();
+
+            std::string output = R"DONE(
 v 2 2
+p -1 # iteration 2)DONE";
+
+            if (!test(filename, got.str(), output)) {
+                tests_pass = false;
+            }
+        }
+    }
+
+    // Budgets limit the elements written by calls which run too often to log in full, dropped elements only cost a
+    // counter increment. SampledObj keeps a uniform random sample of the elements instead
+    {
+        Obj obj;
+        obj.set_sample_every(10).set_max_elements(2);
+        for (int i = 0; i < 100; i++) {
+            obj.point2(V2(i, 0)).annotation("iteration").insert(i); // Dropped elements skip the annotation too
+        }
+
+        std::string output = R"DONE(
+v 0 0
+p -1 # iteration 0
 v 10 0
-v 2 -2
-v 0 -10
-v -2 -2
-v -10 0
-v -2 2
-v 0 10
-l -8 -7 -6 -5 -4 -3 -2 -1 -8 # star boundary
+p -1 # iteration 10
+# Budget dropped 98 elements)DONE";
+
+        if (!test("prizm_documentation_ex11.obj", obj.to_std_string(), output)) {
+            tests_pass = false;
+        }
+
+        SampledObj sampled(3);
+        for (int i = 0; i < 50; i++) {
+            if (Obj* sample = sampled.next()) sample->point2(V2(i, 0));
+        }
+
+        output = R"DONE(
+
+v 22 0
+p -1
+
+
+v 37 0
+p -1
+
+
+v 44 0
+p -1
+
+# Sampled 3 of 50 elements)DONE";
+
+        if (!test("prizm_documentation_ex11_sampled.obj", sampled.merge().to_std_string(), output)) {
+            tests_pass = false;
+        }
+    }
+
+    // A region of interest drops elements which are entirely outside it. The bulk writers (e.g., mesh3) only write the
+    // vertices referenced by the kept elements
+    {
+        Obj obj;
+        obj.set_region_aabb(V3(0, 0, 0), V3(1, 1, 1));
+        for (int i = 0; i < 4; i++) {
+            obj.segment3(V3(i, 0, 0), V3(i + .5, 0, 0)).annotation("segment").insert(i); // Dropped for i > 1
+        }
+
+        float XYZs[6*3] = {0,0,0,  1,0,0,  0,1,0,  5,5,5,  6,5,5,  5,6,5};
+        int IJKs[2*3] = {3,4,5,  0,1,2};
+        obj.mesh3(6, XYZs, 2, IJKs); // Only writes the second triangle and its vertices
+
+        std::string output = R"DONE(
+v 0 0 0
+v 0.5 0 0
+l -2 -1 # segment 0
+v 1 0 0
+v 1.5 0 0
+l -2 -1 # segment 1
+v 0 0 0
+v 1 0 0
+v 0 1 0
+f -3 -2 -1)DONE";
+
+        if (!test("prizm_documentation_ex12.obj", obj.to_std_string(), output)) {
+            tests_pass = false;
+        }
+    }
+
+    // Quantization writes vertex positions as integer coordinates on a grid, with a spacing given by the error you
+    // accept, so large files are several times smaller. The viewer dequantizes them using the quantize directive
+    {
+        Obj obj;
+        obj.set_quantization(V3(0, 0, 0), V3(10, 10, 10), .005);
+        obj.point3(V3(1.234, 5.678, 9.1));
+
+        std::string output = R"DONE(
+quantize 0 0 0 10 10 10 0.01
+v 123 568 910
+p -1)DONE";
+
+        if (!test("prizm_documentation_ex13.obj", obj.to_std_string(), output)) {
+            tests_pass = false;
+        }
+    }
+
+    // In welding mode the soup writers reuse vertices which were written before, so shared vertices are written once
+    {
+        Obj obj;
+        obj.set_welding(true);
+        obj.triangle3(V3{0, 0, 0}, V3{1, 0, 0}, V3{0, 1, 0});
+        obj.triangle3(V3{1, 0, 0}, V3{1, 1, 0}, V3{0, 1, 0}); // Only writes the new vertex
+
+        std::string output = R"DONE(
+v 0 0 0
+v 1 0 0
+v 0 1 0
+f -3 -2 -1
+v 1 1 0
+f -3 -1 -2)DONE";
+
+        if (!test("prizm_documentation_ex14.obj", obj.to_std_string(), output)) {
+            tests_pass = false;
+        }
+    }
+
+    // If you only need your debug output when something goes wrong, record it in a FlightRecorder which keeps the most
+    // recent snapshots in memory and writes them to files when you call dump(), or when the program crashes if you
+    // called install_signal_handlers()
+    {
+        FlightRecorder recorder("prizm_documentation_ex15_", 2);
+        for (int i = 0; i < 3; i++) {
+            Obj obj;
+            obj.point2(V2(i, i)).annotation("iteration").insert(i);
+            recorder.record(obj);
+        }
+        if (write_files) {
+            recorder.dump(); // Writes prizm_documentation_ex15_1.obj and prizm_documentation_ex15_2.obj
+        }
+
+        std::string output = R"DONE(
+v 1 1
+p -1 # iteration 1
 v 2 2
-v 10 0
-v 2 -2
-v 0 -10
-v -2 -2
-v -10 0
-v -2 2
-v 0 10
-f -8 -7 -6 -5 -4 -3 -2 -1 # star polygon
-f -8 -7 -6 -5 -4 -3 -2 -1 # star polygon again
-v -10 -10
-v 10 -10
-v 10 10
-v -10 10
-v -10 -10
-l -5 -4 -3 -2 -1 # star bounding box
-v 4 7
-p -1 # these are concatenated
-v 3 3
-p -1 # some string @ 42 @ 0 0
+p -1 # iteration 2)DONE";
 
+        if (!test("prizm_documentation_ex15.obj", recorder.snapshot(0) + recorder.snapshot(1), output)) {
+            tests_pass = false;
+        }
+    }
 
-## Command Annotations:
-#! set_annotations_visible 0 1
-#! set_annotations_scale 0 1
-#! set_annotations_color 0 0 0 255 255
-#! set_vertex_index_labels_visible 0 0
-#! set_vertex_position_labels_visible 0 0
-#! set_vertex_label_color 0 0 0 0 255
-#! set_vertex_label_scale 0 0.4
-#! set_vertex_annotations_visible 0 1
-#! set_point_index_labels_visible 0 0
-#! set_point_label_color 0 255 0 0 255
-#! set_point_label_scale 0 0.4
-#! set_point_annotations_visible 0 1
-#! set_segment_index_labels_visible 0 0
-#! set_segment_label_color 0 0 255 0 255
-#! set_segment_label_scale 0 0.4
-#! set_segment_annotations_visible 0 1
-#! set_triangle_index_labels_visible 0 0
-#! set_triangle_label_color 0 0 0 255 255
-#! set_triangle_label_scale 0 0.4
-#! set_triangle_annotations_visible 0 1
-#! set_vertices_visible 0 1
-#! set_vertices_color 0 0 0 255 255
-#! set_vertices_size 0 7
-#! set_points_visible 0 1
-#! set_points_color 0 255 0 0 255
-#! set_points_size 0 3
-#! set_segments_visible 0 1
-#! set_segments_color 0 255 0 0 255
-#! set_segments_width 0 3
-#! set_edges_visible 0 1
-#! set_edges_color 0 0 0 0 255
-#! set_edges_width 0 4
-#! set_triangles_visible 0 1
-#! set_triangles_color 0 0 255 0 255
-)DONE";
+    // If your program creates many short-lived Objs, e.g., one per iteration of a hot loop, note the memory of destroyed
+    // Objs is recycled by a thread-local BufferPool. You can also allocate an Obj from a std::pmr memory resource
+    {
+        char arena[8192];
+        std::pmr::monotonic_buffer_resource resource(arena, sizeof(arena), std::pmr::null_memory_resource());
+
+        Obj obj(&resource); // Uses no heap memory
+        obj.segment2(V2(0, 0), V2(1, 1));
+
+        std::string output = R"DONE(
+v 0 0
+v 1 1
+l -2 -1)DONE";
+
+        if (!test("prizm_documentation_ex16.obj", obj.to_std_string(), output)) {
+            tests_pass = false;
+        }
+    }
+
+    // Large bulk writes can be formatted using several threads, the output is identical to the single-threaded output
+    {
+        std::vector<double> coords(3 * 1000);
+        for (size_t i = 0; i < coords.size(); i++) coords[i] = i / 7.;
+
+        Obj serial;
+        serial.set_use_negative_indices(false).points3(strided<3>(coords.data(), 1000));
+
+        Obj parallel;
+        parallel.set_use_negative_indices(false).set_thread_count(4, 100).points3(strided<3>(coords.data(), 1000));
+
+        if (!test("prizm_documentation_ex17.obj", parallel.to_std_string(), serial.to_std_string())) {
+            tests_pass = false;
+        }
+    }
+
+    // The indexing mode and precision can be fixed at compile time using a StaticPolicy, the output is identical to the
+    // output of an Obj configured at runtime. Note you can compile out all Prizm calls by defining PRIZM_DISABLE
+    {
+        std::vector<float> coords = {0, 0, 0, 1, 0, 0, 0, 1, 0, 0.1f, 0.2f, 0.3f};
+        int ijks[] = {0, 1, 2, 1, 2, 3};
+
+        Obj dynamic;
+        dynamic.set_use_negative_indices(false).mesh3(4, coords.data(), 2, ijks).point(2);
+
+        BasicObj<StaticPolicy<false>> fixed;
+        fixed.mesh3(4, coords.data(), 2, ijks).point(2);
+
+        if (!test("prizm_documentation_ex18.obj", fixed.to_std_string(), dynamic.to_std_string())) {
+            tests_pass = false;
+        }
+    }
+
+    // This block illustrates streaming mode, which is useful for very large files or long-running programs
+    {
+        if (write_files) {
+            std::string filename = "prizm_documentation_ex19.obj";
+            {
+                // Use a tiny flush_size so the text is written to the file in several pieces
+                Obj obj(filename, 16);
+                obj.segment2(V2{0, 0}, V2{1, 0});
+                obj.point3(V3{1, 2, 3}).annotation("flushed by the destructor");
+            }
+
+            std::ifstream file(filename, std::ifstream::binary);
+            std::stringstream got;
+            got << file.rdbuf();
+
+            std::string output = R"DONE(
+v 0 0
+v 1 0
+l -2 -1
+v 1 2 3
+p -1 # flushed by the destructor)DONE";
 
-        // Since this` documentation` function you are reading is used for testing we actually call the `to_std_string`
-        // function here to generate a string to compare with `output`
-        if (!test("prizm_documentation_ex1.obj", obj.to_std_string(), output)) {
-            tests_pass = false;
+            if (!test(filename, got.str(), output)) {
+                tests_pass = false;
+            }
         }
     }
 
+    // In sharded streaming mode the output is split into files of about the given size, which stay valid OBJ files
+    // when you write a lot of data, and a manifest listing them which you can load in the viewer to load them all
+    {
+        if (write_files) {
+            {
+                Obj obj("prizm_documentation_ex20.obj", 16, 16); // Tiny flush and shard sizes, so we get two shards
+                obj.segment2(V2{0, 0}, V2{1, 0});
+                obj.segment2(V2{0, 1}, V2{1, 1});
+
+                // If the program crashed here the manifest would still list the shard being written
+                std::ifstream file("prizm_documentation_ex20.shards", std::ifstream::binary);
+                std::stringstream got;
+                got << file.rdbuf();
+
+                std::string output = R"DONE(# Prizm shard manifest, see Prizm::Obj
+shard prizm_documentation_ex20.0000.obj 2 0 0 0 1 0 0
+shard prizm_documentation_ex20.0001.obj
+)DONE";
 
+                if (!test("prizm_documentation_ex20_crash.shards", got.str(), output)) {
+                    tests_pass = false;
+                }
+            }
 
+            std::ifstream file("prizm_documentation_ex20.shards", std::ifstream::binary);
+            std::stringstream got;
+            got << file.rdbuf();
 
+            std::string output = R"DONE(# Prizm shard manifest, see Prizm::Obj
+shard prizm_documentation_ex20.0000.obj 2 0 0 0 1 0 0
+shard prizm_documentation_ex20.0001.obj 2 0 1 0 1 1 0
+)DONE";
 
-    // This block illustrates how, if you use only relative indexing for point/segment/triangle elements, you can use
-    // the `append` function to concatenate different obj files
+            if (!test("prizm_documentation_ex20.shards", got.str(), output)) {
+                tests_pass = false;
+            }
+        }
+    }
+
+    // Writing to a filename ending with ".prizmb" uses a binary format which the viewer loads much faster than OBJ
+    // text. Converting it back to text gives the mesh the viewer builds, e.g., polylines are split into segments
     {
-        // Create the first obj
-        Obj first;
-        first.comment("The first obj:").segment2(V2{0, 0}, V2{1, 0});
+        Obj obj;
+        obj.vertex3(V3{0, 0, 0}, Color(255, 0, 0)).annotation("origin");
+        obj.polyline2(3, V2{1, 0}, V2{1, 1}, V2{0, 1});
+        obj.set_annotations_visible(true);
 
-        // Create the second obj
-        Obj second;
-        second.comment("The second obj:").point3(V3{1, 2, 3});
+        std::string output = R"DONE(
+v 0 0 0 1 0 0 # origin
+v 1 0 0
+v 1 1 0
+v 0 1 0
+l 2 3
+l 3 4
 
-        // Concatenate the objs
-        first.append(second);
+#! set_annotations_visible 0 1
+)DONE";
 
-        std::string output = R"DONE(## The first obj:
+        std::string prizmb = obj_to_prizmb(obj.to_std_string());
+        if (!test("prizm_documentation_ex21.obj", prizmb_to_obj(prizmb), output)) {
+            tests_pass = false;
+        }
+    }
+
+    // A FrameWriter appends Objs as frames of a single .prizmf file, which the viewer opens as one item with a slider
+    // to scrub through the frames. This is much lighter than writing a file per frame when you have many frames
+    {
+        if (write_files) {
+            {
+                FrameWriter frames("prizm_documentation_ex22.prizmf");
+                for (int i = 0; i < 3; i++) {
+                    Obj obj;
+                    obj.segment2(V2{0, 0}, V2{1, static_cast<double>(i)});
+                    frames.add(obj);
+                }
+            }
+
+            std::string got;
+            std::vector<std::string> frames = read_frames("prizm_documentation_ex22.prizmf");
+            for (size_t i = 0; i < frames.size(); i++) {
+                got += "# Frame " + std::to_string(i) + frames[i] + "\n";
+            }
+
+            std::string output = R"DONE(# Frame 0
 v 0 0
 v 1 0
 l -2 -1
-## The second obj:
-v 1 2 3
-p -1
+# Frame 1
+v 0 0
+v 1 1
+l -2 -1
+# Frame 2
+v 0 0
+v 1 2
+l -2 -1
 )DONE";
 
-        if (!test("prizm_documentation_ex2.obj", first.to_std_string(), output)) {
-            tests_pass = false;
+            if (!test("prizm_documentation_ex22.obj", got, output)) {
+                tests_pass = false;
+            }
         }
     }
 
+    // A DeltaWriter writes the first frame in full and later frames as deltas, which only list what changed since the
+    // previous frame. Loading the deltas in the viewer patches the item loaded from the first frame
+    {
+        if (write_files) {
+            DeltaWriter deltas("prizm_documentation_ex23.obj");
+
+            Obj obj;
+            obj.triangle2(V2{0, 0}, V2{1, 0}, V2{0, 1});
+            deltas.write(obj);
+
+            Obj moved;
+            moved.triangle2(V2{0, 0}, V2{2, 0}, V2{0, 1});
+            moved.point2(V2{1, 1});
+            std::string filename = deltas.write(moved);
+
+            std::ifstream file(filename, std::ifstream::binary);
+            std::stringstream got;
+            got << file.rdbuf();
+
+            std::string output = R"DONE(# Prizm delta, see Prizm::DeltaWriter
+base prizm_documentation_ex23.obj 1 3 0 0 1
+vertex_count 4
+v 2 2 0 0
+v 4 1 1 0
+points 0
+p 4
+)DONE";
 
-    // @TODO Add an example where the append function can be used to add a common footer to multiple obj files (this would be slightly easier than defining a lambda to append it to the given Obj)
-
+            if (!test("prizm_documentation_ex23.0001.prizmd", got.str(), output)) {
+                tests_pass = false;
+            }
+        }
+    }
 
-    // Some obj viewers do not support negative indices so there is an option to use positive indices instead
+    // A prototype shape is declared once and then placed by instances, each with its own transform and color. Note
+    // the prototype vertices are not counted by positive indices written after the prototype
     {
         Obj obj;
         obj.set_use_negative_indices(false);
-        obj.segment2(V2{0, 0}, V2{1, 0});
-        obj.point3(V3{1, 2, 3});
+        obj.prototype_begin("marker").segment3(V3{0, 0, 0}, V3{0, 0, 1}).prototype_end();
+        obj.instance("marker", V3{1, 2, 3}, V3{1, 1, 2}, RED);
+        obj.instance("marker", V4{0, -1, 0, 0}, V4{1, 0, 0, 0}, V4{0, 0, 1, 0});
+        obj.point3(V3{0, 0, 0});
 
         std::string output = R"DONE(
-v 0 0
-v 1 0
+prototype marker
+v 0 0 0
+v 0 0 1
 l 1 2
-v 1 2 3
-p 3)DONE";
+prototype_end
+instance marker 1 0 0 1 0 1 0 2 0 0 2 3 1 0 0
+instance marker 0 -1 0 0 1 0 0 0 0 0 1 0
+v 0 0 0
+p 1)DONE";
 
-        if (!test("prizm_documentation_ex3.obj", obj.to_std_string(), output)) {
+        if (!test("prizm_documentation_ex24.obj", obj.to_std_string(), output)) {
             tests_pass = false;
         }
     }
 
+    // spheres3 writes many spheres in one call, each one is the cached unit sphere (see unit_sphere_mesh) scaled and
+    // translated and then written like mesh3 writes it
+    {
+        std::vector<double> centers = {0, 0, 0, 5, 0, 0};
+        std::vector<double> radii = {1, 2};
 
+        Obj obj;
+        obj.spheres3(2, centers.data(), radii.data(), 8, 6);
+
+        Obj expected;
+        const SphereMesh& unit = unit_sphere_mesh(8, 6);
+        for (int s = 0; s < 2; s++) {
+            std::vector<double> xyzs;
+            for (size_t i = 0; i < unit.points.size(); i++) {
+                xyzs.push_back(static_cast<double>(unit.points[i]) * radii[s] + centers[3*s + i%3]);
+            }
+            expected.mesh3(static_cast<int>(xyzs.size() / 3), xyzs.data(),
+                           static_cast<int>(unit.triangles.size() / 3), unit.triangles.data());
+        }
 
+        if (!test("prizm_documentation_ex25.obj", obj.to_std_string(), expected.to_std_string())) {
+            tests_pass = false;
+        }
+    }
 
+    // boxes3 writes many boxes in one call, e.g., to dump the nodes of a tree. Each box writes its corners once and its
+    // 12 edges with a polyline and 3 segments, the depth attribute lets the viewer show only some levels of the tree
+    {
+        double mins[] = {0, 0, 0};
+        double maxs[] = {2, 1, 1};
+        int depths[] = {3};
 
+        Obj obj;
+        obj.set_use_negative_indices(false);
+        obj.boxes3(1, mins, maxs, depths);
 
-    // This block illustrates a possibly handy use-case where you can create and write an obj file in one line
-    {
-        // We don't test this function to keep everything on a single line
-        if (write_files) {
-            std::string filename = "prizm_documentation_ex4.obj";
-            Obj().triangle2(V2{0., 0.}, V2{1., 0.}, V2{1., 1.}).annotation("triangle").point2(V2{3., 3.}).annotation("point").write(filename);
-            std::cout << "Wrote " << filename << std::endl;
+        std::string output = R"DONE(
+v 0 0 0
+v 2 0 0
+v 0 1 0
+v 2 1 0
+v 0 0 1
+v 2 0 1
+v 0 1 1
+v 2 1 1
+l 1 2 4 3 1 5 6 8 7 5 # @depth 3
+l 2 6 # @depth 3
+l 3 7 # @depth 3
+l 4 8 # @depth 3)DONE";
+
+        if (!test("prizm_documentation_ex26.obj", obj.to_std_string(), output)) {
+            tests_pass = false;
         }
     }
 
+    // vectors3 writes a vector field as oriented points, which the viewer draws as vectors from the point normals. The
+    // commands show the vectors with their magnitudes, here doubled, rather than normalized
+    {
+        double origins[] = {0, 0, 0,  1, 0, 0};
+        double vectors[] = {0, 0, 1,  .5, .5, 0};
 
+        Obj obj;
+        obj.set_use_negative_indices(false);
+        obj.vectors3(2, origins, vectors, 2);
 
+        std::string output = R"DONE(
+v 0 0 0
+v 1 0 0
+vn 0 0 1
+vn 0.5 0.5 0
+p 1//1
+p 2//2
+#! set_point_normals_visible 0 1
+#! set_point_normals_scale 0 2 0)DONE";
+
+        if (!test("prizm_documentation_ex27.obj", obj.to_std_string(), output)) {
+            tests_pass = false;
+        }
+    }
 
+    // prizmb_to_obj returns an empty string for a file which is truncated, or whose sections have an item size or count
+    // which doesn't match their tag, rather than reading past the end of the data
+    {
+        Obj obj;
+        obj.vertex3(V3{0, 0, 0}, Color(255, 0, 0));
+        obj.point3(V3{1, 0, 0});
+        std::string prizmb = obj_to_prizmb(obj.to_std_string());
+
+        std::string truncated = prizmb.substr(0, prizmb.size() - 8);
+        std::string bad_item_size = prizmb;
+        bad_item_size[20] = 16; // The item size of the POSN section, which is the first one
+
+        std::string got;
+        got += "valid " + std::to_string(!prizmb_to_obj(prizmb).empty()) + "\n";
+        got += "truncated " + std::to_string(!prizmb_to_obj(truncated).empty()) + "\n";
+        got += "bad_item_size " + std::to_string(!prizmb_to_obj(bad_item_size).empty()) + "\n";
+
+        std::string output = R"DONE(valid 1
+truncated 0
+bad_item_size 0
+)DONE";
 
+        if (!test("prizm_documentation_ex28.txt", got, output)) {
+            tests_pass = false;
+        }
+    }
 
-    // This block illustrates another kinda wacky use-case where you could use the Obj class as a debug file logger
-    // for files which have nothing to do with the obj format
+    // A file with vertices but no elements is shown as a point cloud, so its deltas list the points of the vertices
     {
         Obj obj;
-        obj.add("some int =").insert(5).newline();
-        obj.add("some type with operator<< =").insert(V2{2, 3}).newline();
-        if (true) {
-            obj.add("condition passed on line").insert(__LINE__);
-            obj.add("\n"); // We don't care about tracking # chars so just log special characters directly
+        obj.vertex3(V3{0, 0, 0});
+        obj.vertex3(V3{1, 0, 0});
+
+        Obj moved;
+        moved.vertex3(V3{0, 0, 0});
+        moved.vertex3(V3{2, 0, 0});
+        moved.vertex3(V3{0, 1, 0});
+
+        std::string output = R"DONE(# Prizm delta, see Prizm::DeltaWriter
+base prizm_documentation_ex29.obj 1 2 2 0 0
+vertex_count 3
+v 2 2 0 0
+v 3 0 1 0
+points 2
+p 3
+)DONE";
+
+        std::string got = obj_delta(obj.to_std_string(), moved.to_std_string(), "prizm_documentation_ex29.obj", 1);
+        if (!test("prizm_documentation_ex29.0001.prizmd", got, output)) {
+            tests_pass = false;
         }
+    }
 
-        // We don't test this function because the __LINE__ macro makes it brittle
-        if (write_files) {
-            std::string filename = "prizm_documentation_ex5.obj";
-            obj.write(filename);
-            std::cout << "Wrote " << filename << std::endl;
+    // Prototypes and instances are stored in .prizmb files, the shape of each prototype is written before its instances
+    {
+        Obj obj;
+        obj.prototype_begin("marker").triangle3(V3{0, 0, 0}, V3{1, 0, 0}, V3{0, 1, 0}).prototype_end();
+        obj.instance("marker", V3{1, 2, 3}, V3{1, 1, 2}, RED);
+        obj.point3(V3{0, 0, 1});
+        obj.instance("marker", V4{0, -1, 0, 0}, V4{1, 0, 0, 0}, V4{0, 0, 1, 0});
+
+        std::string prizmb = obj_to_prizmb(obj.to_std_string());
+        std::string got = prizmb_to_obj(prizmb);
+        got += "\nsame_prizmb " + std::to_string(obj_to_prizmb(got) == prizmb) + "\n";
+
+        std::string output = R"DONE(
+prototype marker
+v 0 0 0
+v 1 0 0
+v 0 1 0
+f 1 2 3
+prototype_end
+instance marker 1 0 0 1 0 1 0 2 0 0 2 3 1 0 0
+instance marker 0 -1 0 0 1 0 0 0 0 0 1 0
+v 0 0 1
+p 1
+same_prizmb 1
+)DONE";
+
+        if (!test("prizm_documentation_ex30.obj", got, output)) {
+            tests_pass = false;
         }
     }
 
     return tests_pass;
 }
+#endif // PRIZM_DISABLE
 
 #ifdef PRIZM_VEC2_CLASS_EXTRA
 #undef PRIZM_VEC2_CLASS_EXTRA
@@ -1652,25 +5930,756 @@ p 3)DONE";
 
 namespace Prizm {
 
-Obj& Obj::sphere3(V3f center, float radius, int slices, int stacks) {
+const SphereMesh& unit_sphere_mesh(int slices, int stacks) {
     int use_slices = std::max(3, slices);
     int use_stacks = std::max(3, stacks);
 
-    par_shapes_mesh* mesh = par_shapes_create_parametric_sphere(use_slices, use_stacks);
-    par_shapes_scale(mesh, radius, radius, radius);
-    par_shapes_translate(mesh, center.x, center.y, center.z);
+    // The meshes are never freed so references to them stay valid
+    static std::mutex mutex;
+    static std::unordered_map<uint64_t, std::unique_ptr<SphereMesh>> cache;
+    uint64_t key = (static_cast<uint64_t>(use_slices) << 32) | static_cast<uint32_t>(use_stacks);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::unique_ptr<SphereMesh>& cached = cache[key];
+    if (!cached) {
+        par_shapes_mesh* mesh = par_shapes_create_parametric_sphere(use_slices, use_stacks);
+        cached = std::make_unique<SphereMesh>();
+        cached->points.assign(mesh->points, mesh->points + mesh->npoints * 3);
+        cached->triangles.assign(mesh->triangles, mesh->triangles + mesh->ntriangles * 3);
+        par_shapes_free_mesh(mesh);
+    }
+    return *cached;
+}
+
+namespace {
+
+constexpr uint32_t prizmb_missing_index = 0xFFFFFFFF;
+
+std::string_view prizmb_trim(std::string_view text, std::string_view chars = "# \t\r\n") {
+    size_t first = text.find_first_not_of(chars);
+    if (first == std::string_view::npos) return {};
+    return text.substr(first, text.find_last_not_of(chars) - first + 1);
+}
+
+// The viewer's annotation text for a line containing a #: the text between the first # and the next # or the end
+std::string_view prizmb_between_hashes(std::string_view text) {
+    text = text.substr(1);
+    return prizmb_trim(text.substr(0, text.find('#')));
+}
+
+bool prizmb_parse(std::string_view word, double& value) {
+    const char* first = word.data();
+    if (!word.empty() && word[0] == '+') first++; // Accepted by the viewer but not by from_chars
+    std::from_chars_result result = std::from_chars(first, word.data() + word.size(), value);
+    return result.ec == std::errc() && result.ptr == word.data() + word.size();
+}
+
+// True if `word` is read as an identifier by the viewer, which is the case for prototype names
+bool prizmb_is_identifier(std::string_view word) {
+    auto letter = [](char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_'; };
+    if (word.empty() || !letter(word[0])) return false;
+    return std::all_of(word.begin(), word.end(), [&](char c) { return letter(c) || (c >= '0' && c <= '9'); });
+}
+
+// Move the vertices and elements added to `mesh` since the counts in `start` into a new prototype, like the viewer
+// does at a prototype_end directive. The prototype is dropped if an element references a vertex outside it, and
+// annotations on the shape are dropped
+void prizmb_finish_prototype(PrizmbMesh& mesh, const std::string& name, const size_t start[5]) {
+    PrizmbMesh::Prototype prototype;
+    prototype.name = name;
+    prototype.positions.assign(mesh.positions.begin() + start[0], mesh.positions.end());
+
+    bool valid = true;
+    uint32_t vertex_begin = static_cast<uint32_t>(start[0] / 3);
+    uint32_t vertex_end = static_cast<uint32_t>(mesh.positions.size() / 3);
+    auto move_elements = [&](std::vector<uint32_t>& elements, size_t begin, std::vector<uint32_t>& shape_elements) {
+        for (size_t i = begin; i < elements.size(); i++) {
+            valid = valid && elements[i] >= vertex_begin && elements[i] < vertex_end; // Also false for missing vertices
+            shape_elements.push_back(elements[i] - vertex_begin);
+        }
+        elements.resize(begin);
+    };
+
+    // The triangle normals are kept if every triangle has them
+    if (mesh.triangles.size() > start[3] && mesh.triangle_normals.size() == 3 * mesh.triangles.size()) {
+        prototype.triangle_normals.assign(mesh.triangle_normals.begin() + 3 * start[3], mesh.triangle_normals.end());
+    }
+    move_elements(mesh.points, start[1], prototype.points);
+    move_elements(mesh.segments, start[2], prototype.segments);
+    move_elements(mesh.triangles, start[3], prototype.triangles);
+    mesh.positions.resize(start[0]);
+    mesh.colors.resize(start[0]);
+    mesh.point_normals.resize(std::min(mesh.point_normals.size(), 3 * start[1]));
+    mesh.segment_normals.resize(std::min(mesh.segment_normals.size(), 3 * start[2]));
+    mesh.triangle_normals.resize(std::min(mesh.triangle_normals.size(), 3 * start[3]));
+
+    // Annotations of the shape's vertices and elements are dropped, comments are kept
+    mesh.annotations.erase(std::remove_if(mesh.annotations.begin() + start[4], mesh.annotations.end(), [](const auto& annotation) {
+        return annotation.kind < PrizmbMesh::BLOCK;
+    }), mesh.annotations.end());
+
+    if (valid) mesh.prototypes.push_back(std::move(prototype));
+}
+
+// Returns the 0-based index referenced by the 1-based, or negative relative, OBJ index, or -1 if it is missing
+int64_t prizmb_resolve(int64_t obj_index, size_t count) {
+    int64_t index = obj_index > 0 ? obj_index - 1 : static_cast<int64_t>(count) + obj_index;
+    return obj_index != 0 && index >= 0 && index < static_cast<int64_t>(count) ? index : -1;
+}
+
+} // namespace
+
+PrizmbMesh prizmb_mesh_from_obj(std::string_view obj) {
+    PrizmbMesh mesh;
+    std::vector<double> normals; // Values of the vn-directives, referenced by elements
+
+    // Consecutive comment lines are grouped like they are by the viewer
+    std::vector<std::string_view> block;
+    std::vector<std::string_view> commands;
+    uint32_t block_count = 0;
+    size_t last_comment_line = 0;
+    auto end_comment_group = [&]() {
+        std::string text;
+        for (size_t i = 0; i < block.size(); i++) {
+            if (i) text += '\n';
+            text += block[i];
+        }
+        if (!prizmb_trim(text).empty()) {
+            mesh.annotations.push_back({PrizmbMesh::BLOCK, block_count++, text});
+        }
+        for (std::string_view command : commands) {
+            if (!command.empty()) mesh.annotations.push_back({PrizmbMesh::COMMAND, 0, std::string(command)});
+        }
+        block.clear();
+        commands.clear();
+    };
+
+    bool quantized = false;
+    double quantize_min[3] = {};
+    double quantize_step = 1;
+    // Set while a prototype is declared, the counts of the mesh arrays when the declaration started
+    std::string prototype_name;
+    size_t prototype_start[5] = {};
+
+    std::vector<std::string_view> words;
+    std::vector<int64_t> vertex_refs, normal_refs;
+    size_t line_number = 0;
+    for (size_t begin = 0; begin < obj.size(); line_number++) {
+        size_t end = std::min(obj.find('\n', begin), obj.size());
+        std::string_view line = prizmb_trim(obj.substr(begin, end - begin), " \t\r");
+        begin = end + 1;
+        if (line.empty()) continue;
+
+        if (line[0] == '#') {
+            if (line_number - last_comment_line >= 2) end_comment_group();
+            last_comment_line = line_number;
+            std::string_view remainder = prizmb_between_hashes(line);
+            if (!remainder.empty() && remainder[0] == '!') {
+                commands.push_back(prizmb_trim(remainder.substr(1), " \t\r\n"));
+            } else {
+                block.push_back(remainder);
+            }
+            continue;
+        }
+        end_comment_group();
+        last_comment_line = 0;
+
+        // Split the line into the directive, its arguments and the annotation
+        size_t hash = line.find('#');
+        std::string_view annotation = hash == std::string_view::npos ? std::string_view() : prizmb_between_hashes(line.substr(hash));
+        std::string_view arguments = line.substr(0, hash);
+        words.clear();
+        for (size_t i = 0; i < arguments.size();) {
+            size_t first = arguments.find_first_not_of(" \t\r", i);
+            if (first == std::string_view::npos) break;
+            size_t last = std::min(arguments.find_first_of(" \t\r", first), arguments.size());
+            words.push_back(arguments.substr(first, last - first));
+            i = last;
+        }
+        if (words.empty()) continue;
+        std::string_view directive = words[0];
+
+        if (directive == "prototype") {
+            // Like the viewer, nested declarations are ignored and a declaration without a name is shown as usual
+            if (prototype_name.empty() && words.size() >= 2 && prizmb_is_identifier(words[1])) {
+                prototype_name = std::string(words[1]);
+                size_t start[5] = {mesh.positions.size(), mesh.points.size(), mesh.segments.size(), mesh.triangles.size(), mesh.annotations.size()};
+                std::memcpy(prototype_start, start, sizeof(start));
+            }
+        } else if (directive == "prototype_end") {
+            if (!prototype_name.empty()) prizmb_finish_prototype(mesh, prototype_name, prototype_start);
+            prototype_name.clear();
+        } else if (directive == "instance") {
+            double values[15];
+            size_t n = std::min<size_t>(words.size() < 2 ? 0 : words.size() - 2, 15);
+            bool valid = words.size() >= 2 && prizmb_is_identifier(words[1]) && (n == 12 || n == 15);
+            for (size_t i = 0; valid && i < n; i++) {
+                valid = prizmb_parse(words[i + 2], values[i]);
+                if (!std::isfinite(values[i])) values[i] = 0;
+            }
+
+            // The instance is of the last valid prototype declared with the name, like the viewer
+            size_t prototype = mesh.prototypes.size();
+            while (valid && prototype > 0 && mesh.prototypes[prototype - 1].name != words[1]) prototype--;
+            if (valid && prototype > 0) {
+                PrizmbMesh::Instance instance;
+                std::memcpy(instance.rows, values, sizeof(instance.rows));
+                instance.prototype = static_cast<uint32_t>(prototype - 1);
+                for (int d = 0; d < 3; d++) {
+                    instance.color[d] = n == 15 ? float(values[12 + d]) : std::numeric_limits<float>::quiet_NaN();
+                }
+                mesh.instances.push_back(instance);
+            }
+        } else if (directive == "v") {
+            double values[6] = {0, 0, 0, 0, 0, 0};
+            int n = 0;
+            while (n < 6 && n + 1 < static_cast<int>(words.size()) && prizmb_parse(words[n + 1], values[n])) n++;
+            if (n < 2) continue;
+            bool is_2d = n == 2 || n == 5;
+            double x = values[0], y = values[1], z = is_2d ? 0 : values[2];
+            if (quantized && std::isfinite(x) && std::isfinite(y) && std::isfinite(z)) {
+                x = quantize_min[0] + x * quantize_step;
+                y = quantize_min[1] + y * quantize_step;
+                if (!is_2d) z = quantize_min[2] + z * quantize_step;
+            }
+            mesh.positions.insert(mesh.positions.end(), {x, y, z});
+            float nan = std::numeric_limits<float>::quiet_NaN();
+            if (n >= 5) {
+                for (int d = 0; d < 3; d++) {
+                    double color = values[(is_2d ? 2 : 3) + d];
+                    mesh.colors.push_back(std::isfinite(color) ? float(color) : .8f); // The viewer's default color
+                }
+            } else {
+                mesh.colors.insert(mesh.colors.end(), {nan, nan, nan});
+            }
+            if (!annotation.empty()) {
+                uint32_t id = static_cast<uint32_t>(mesh.positions.size() / 3 - 1);
+                mesh.annotations.push_back({PrizmbMesh::VERTEX, id, std::string(annotation)});
+            }
+        } else if (directive == "vn") {
+            double values[3] = {0, 0, 0};
+            for (int d = 0; d < 3 && d + 1 < static_cast<int>(words.size()); d++) {
+                if (!prizmb_parse(words[d + 1], values[d]) || !std::isfinite(values[d])) values[d] = 0;
+            }
+            normals.insert(normals.end(), values, values + 3);
+        } else if (directive == "quantize") {
+            double values[7];
+            quantized = words.size() >= 8;
+            for (int i = 0; quantized && i < 7; i++) quantized = prizmb_parse(words[i + 1], values[i]);
+            if (quantized) {
+                std::memcpy(quantize_min, values, sizeof(quantize_min));
+                quantize_step = values[6];
+            }
+        } else if (directive == "p" || directive == "l" || directive == "f") {
+            vertex_refs.clear();
+            normal_refs.clear();
+            bool valid = true;
+            for (size_t w = 1; w < words.size(); w++) {
+                std::string_view ref = words[w];
+                size_t slash = ref.find('/');
+                int64_t index = 0;
+                std::from_chars_result result = std::from_chars(ref.data(), ref.data() + std::min(slash, ref.size()), index);
+                if (result.ec != std::errc()) valid = false;
+                vertex_refs.push_back(index);
+                size_t normal_slash = slash == std::string_view::npos ? slash : ref.find('/', slash + 1);
+                if (normal_slash != std::string_view::npos && normal_slash + 1 < ref.size()) {
+                    int64_t normal = 0;
+                    std::from_chars(ref.data() + normal_slash + 1, ref.data() + ref.size(), normal);
+                    normal_refs.push_back(normal);
+                }
+            }
+
+            // Same validity rules as the viewer
+            size_t min_count = directive == "p" ? 1 : directive == "l" ? 2 : 3;
+            if (!valid || vertex_refs.size() < min_count) continue;
+            if (!normal_refs.empty() && normal_refs.size() != vertex_refs.size()) continue;
+
+            size_t vertex_count = mesh.positions.size() / 3;
+            auto vertex = [&](size_t i) {
+                int64_t index = prizmb_resolve(vertex_refs[i], vertex_count);
+                return index < 0 ? prizmb_missing_index : static_cast<uint32_t>(index);
+            };
+            auto add_normal = [&](std::vector<double>& element_normals, size_t i) {
+                int64_t index = prizmb_resolve(normal_refs[i], normals.size() / 3);
+                for (int d = 0; d < 3; d++) element_normals.push_back(index < 0 ? 0 : normals[3 * index + d]);
+            };
+
+            // Elements of this directive, each is `corners` indices into vertex_refs
+            std::vector<uint32_t>& elements = directive == "p" ? mesh.points : directive == "l" ? mesh.segments : mesh.triangles;
+            std::vector<double>& element_normals = directive == "p" ? mesh.point_normals : directive == "l" ? mesh.segment_normals : mesh.triangle_normals;
+            uint32_t kind = directive == "p" ? PrizmbMesh::POINT : directive == "l" ? PrizmbMesh::SEGMENT : PrizmbMesh::TRIANGLE;
+            size_t corners = min_count;
+            size_t element_count = directive == "p" ? vertex_refs.size() : vertex_refs.size() - corners + 1;
+            for (size_t e = 0; e < element_count; e++) {
+                size_t refs[3] = {e, e + 1, e + 2}; // Points and polyline segments
+                if (directive == "f") refs[0] = 0; // Triangle fans
+                if (!normal_refs.empty() && element_normals.size() < elements.size() * 3) {
+                    element_normals.resize(elements.size() * 3, 0); // Zero normals for the previous elements
+                }
+                for (size_t c = 0; c < corners; c++) elements.push_back(vertex(refs[c]));
+                if (!normal_refs.empty()) {
+                    for (size_t c = 0; c < corners; c++) add_normal(element_normals, refs[c]);
+                }
+                if (!annotation.empty()) {
+                    uint32_t id = static_cast<uint32_t>(elements.size() / corners - 1);
+                    mesh.annotations.push_back({kind, id, std::string(annotation)});
+                }
+            }
+        }
+        // Other directives are ignored, like they are by the viewer
+    }
+    end_comment_group();
+    if (!prototype_name.empty()) prizmb_finish_prototype(mesh, prototype_name, prototype_start);
+
+    // The colors of prototype vertices are not used, so only the other vertices need the COLR section
+    mesh.has_colors = std::any_of(mesh.colors.begin(), mesh.colors.end(), [](float c) { return !std::isnan(c); });
+
+    // The viewer stores the instances of each prototype separately, so only their order per prototype matters
+    std::stable_sort(mesh.instances.begin(), mesh.instances.end(), [](const auto& a, const auto& b) {
+        return a.prototype < b.prototype;
+    });
+
+    // Like the viewer, a file without elements or prototypes is a point cloud with a point per vertex
+    if (mesh.points.empty() && mesh.segments.empty() && mesh.triangles.empty() && mesh.prototypes.empty()) {
+        for (size_t v = 0; v < mesh.positions.size() / 3; v++) mesh.points.push_back(static_cast<uint32_t>(v));
+    }
+
+    // Elements after the last one with normals have zero normals
+    if (!mesh.point_normals.empty()) mesh.point_normals.resize(mesh.points.size() * 3, 0);
+    if (!mesh.segment_normals.empty()) mesh.segment_normals.resize(mesh.segments.size() * 3, 0);
+    if (!mesh.triangle_normals.empty()) mesh.triangle_normals.resize(mesh.triangles.size() * 3, 0);
+
+    // The viewer sorts annotations this way, it keeps the order of the commands, which are executed in order
+    std::stable_sort(mesh.annotations.begin(), mesh.annotations.end(), [](const auto& a, const auto& b) {
+        return a.kind != b.kind ? a.kind < b.kind : a.id < b.id;
+    });
+
+    return mesh;
+}
+
+namespace {
+
+void prizmb_append(std::string& out, const void* data, size_t count) {
+    out.append(static_cast<const char*>(data), count);
+}
+
+template <typename Int> void prizmb_append_int(std::string& out, Int value) {
+    for (size_t b = 0; b < sizeof(Int); b++) out += static_cast<char>((value >> (8 * b)) & 0xFF);
+}
+
+// Assumes a little-endian CPU, like the viewer
+void prizmb_append_section(std::string& out, const char* tag, uint32_t item_size, uint64_t item_count, const void* items, size_t byte_count) {
+    prizmb_append(out, tag, 4);
+    prizmb_append_int(out, item_size);
+    prizmb_append_int(out, item_count);
+    prizmb_append(out, items, byte_count);
+    out.append((8 - byte_count % 8) % 8, '\0');
+}
+
+// Write a section of `components` floats per item, as f32 if that is lossless
+void prizmb_append_floats(std::string& out, const char* tag, const std::vector<double>& values, int components) {
+    bool exact = true;
+    for (double value : values) {
+        exact = exact && (static_cast<double>(static_cast<float>(value)) == value || std::isnan(value));
+    }
+    uint64_t item_count = values.size() / components;
+    if (exact) {
+        std::vector<float> floats(values.begin(), values.end());
+        prizmb_append_section(out, tag, 4 * components, item_count, floats.data(), 4 * floats.size());
+    } else {
+        prizmb_append_section(out, tag, 8 * components, item_count, values.data(), 8 * values.size());
+    }
+}
+
+std::string prizmb_from_mesh(const PrizmbMesh& mesh) {
+    std::string out = std::string("PRIZMB\x01\0", 8);
+    uint32_t section_count = 1 + mesh.has_colors + 3
+        + !mesh.point_normals.empty() + !mesh.segment_normals.empty() + !mesh.triangle_normals.empty()
+        + !mesh.annotations.empty() + !mesh.prototypes.empty() + !mesh.instances.empty();
+    prizmb_append_int(out, section_count);
+    prizmb_append_int(out, uint32_t(0));
+
+    prizmb_append_floats(out, "POSN", mesh.positions, 3);
+    if (mesh.has_colors) {
+        prizmb_append_section(out, "COLR", 12, mesh.colors.size() / 3, mesh.colors.data(), 4 * mesh.colors.size());
+    }
+    prizmb_append_section(out, "PNTS", 4, mesh.points.size(), mesh.points.data(), 4 * mesh.points.size());
+    prizmb_append_section(out, "SEGS", 8, mesh.segments.size() / 2, mesh.segments.data(), 4 * mesh.segments.size());
+    prizmb_append_section(out, "TRIS", 12, mesh.triangles.size() / 3, mesh.triangles.data(), 4 * mesh.triangles.size());
+    if (!mesh.point_normals.empty()) prizmb_append_floats(out, "PNRM", mesh.point_normals, 3);
+    if (!mesh.segment_normals.empty()) prizmb_append_floats(out, "SNRM", mesh.segment_normals, 6);
+    if (!mesh.triangle_normals.empty()) prizmb_append_floats(out, "TNRM", mesh.triangle_normals, 9);
+    if (!mesh.annotations.empty()) {
+        std::string items;
+        for (const PrizmbMesh::Annotation& annotation : mesh.annotations) {
+            prizmb_append_int(items, annotation.kind);
+            prizmb_append_int(items, annotation.id);
+            prizmb_append_int(items, static_cast<uint32_t>(annotation.text.size()));
+            items += annotation.text;
+            items.append((4 - annotation.text.size() % 4) % 4, '\0');
+        }
+        prizmb_append_section(out, "ANNO", 0, mesh.annotations.size(), items.data(), items.size());
+    }
+    if (!mesh.prototypes.empty()) {
+        std::string items;
+        for (const PrizmbMesh::Prototype& prototype : mesh.prototypes) {
+            for (size_t count : {prototype.name.size(), prototype.positions.size() / 3, prototype.points.size(),
+                                 prototype.segments.size() / 2, prototype.triangles.size() / 3}) {
+                prizmb_append_int(items, static_cast<uint32_t>(count));
+            }
+            prizmb_append_int(items, uint32_t(!prototype.triangle_normals.empty()));
+            items += prototype.name;
+            items.append((4 - prototype.name.size() % 4) % 4, '\0');
+            prizmb_append(items, prototype.positions.data(), 8 * prototype.positions.size());
+            prizmb_append(items, prototype.points.data(), 4 * prototype.points.size());
+            prizmb_append(items, prototype.segments.data(), 4 * prototype.segments.size());
+            prizmb_append(items, prototype.triangles.data(), 4 * prototype.triangles.size());
+            prizmb_append(items, prototype.triangle_normals.data(), 8 * prototype.triangle_normals.size());
+        }
+        prizmb_append_section(out, "PROT", 0, mesh.prototypes.size(), items.data(), items.size());
+    }
+    if (!mesh.instances.empty()) {
+        static_assert(sizeof(PrizmbMesh::Instance) == 112, "INST items are copied directly");
+        prizmb_append_section(out, "INST", 112, mesh.instances.size(), mesh.instances.data(), 112 * mesh.instances.size());
+    }
+    return out;
+}
+
+} // namespace
+
+std::string obj_to_prizmb(std::string_view obj) {
+    return prizmb_from_mesh(prizmb_mesh_from_obj(obj));
+}
+
+std::string prizmb_to_obj(std::string_view prizmb) {
+    PrizmbMesh mesh;
+
+    // Read the sections
+    auto read_u32 = [&prizmb](size_t offset) {
+        uint32_t value;
+        std::memcpy(&value, prizmb.data() + offset, 4);
+        return value;
+    };
+    if (prizmb.size() < 16 || prizmb.substr(0, 7) != std::string_view("PRIZMB\x01", 7)) return {};
+    uint32_t section_count = read_u32(8);
+    size_t offset = 16;
+    for (uint32_t s = 0; s < section_count; s++) {
+        if (offset + 16 > prizmb.size()) return {};
+        std::string_view tag = prizmb.substr(offset, 4);
+        uint32_t item_size = read_u32(offset + 4);
+        uint64_t item_count;
+        std::memcpy(&item_count, prizmb.data() + offset + 8, 8);
+        offset += 16;
+
+        // Each known tag has a fixed item size, or one for f32 and one for f64 values. Unknown tags are skipped
+        uint32_t float_count = tag == "POSN" || tag == "PNRM" ? 3 : tag == "SNRM" ? 6 : tag == "TNRM" ? 9 : 0;
+        uint32_t index_count = tag == "PNTS" ? 1 : tag == "SEGS" ? 2 : tag == "TRIS" ? 3 : 0;
+        if (float_count && item_size != 4 * float_count && item_size != 8 * float_count) return {};
+        if (index_count && item_size != 4 * index_count) return {};
+        if (tag == "COLR" && item_size != 12) return {};
+        if ((tag == "ANNO" || tag == "PROT") && item_size != 0) return {};
+        if (tag == "INST" && item_size != sizeof(PrizmbMesh::Instance)) return {};
+        if (item_size && item_count > (prizmb.size() - offset) / item_size) return {};
+
+        size_t byte_count = item_size * item_count;
+        if (tag == "ANNO") {
+            byte_count = 0;
+            for (uint64_t i = 0; i < item_count; i++) {
+                if (offset + byte_count + 12 > prizmb.size()) return {};
+                PrizmbMesh::Annotation annotation;
+                annotation.kind = read_u32(offset + byte_count);
+                annotation.id = read_u32(offset + byte_count + 4);
+                uint32_t text_size = read_u32(offset + byte_count + 8);
+                if (offset + byte_count + 12 + text_size > prizmb.size()) return {};
+                annotation.text = std::string(prizmb.substr(offset + byte_count + 12, text_size));
+                byte_count += 12 + text_size + (4 - text_size % 4) % 4;
+                mesh.annotations.push_back(std::move(annotation));
+            }
+        }
+        if (tag == "PROT") {
+            byte_count = 0;
+            for (uint64_t i = 0; i < item_count; i++) {
+                if (offset + byte_count + 24 > prizmb.size()) return {};
+                uint64_t counts[6];
+                for (int c = 0; c < 6; c++) counts[c] = read_u32(offset + byte_count + 4 * c);
+                uint64_t name_size = counts[0] + (4 - counts[0] % 4) % 4;
+                uint64_t triangle_normals_size = counts[5] ? 72 * counts[4] : 0;
+                uint64_t size = 24 + name_size + 24 * counts[1] + 4 * (counts[2] + 2 * counts[3] + 3 * counts[4]) + triangle_normals_size;
+                if (size > prizmb.size() - offset - byte_count) return {};
+
+                const char* item = prizmb.data() + offset + byte_count + 24;
+                PrizmbMesh::Prototype prototype;
+                prototype.name = std::string(item, counts[0]);
+                item += name_size;
+                auto read = [&item](auto& values, uint64_t count) {
+                    values.resize(count);
+                    if (count) std::memcpy(values.data(), item, count * sizeof(values[0]));
+                    item += count * sizeof(values[0]);
+                };
+                read(prototype.positions, 3 * counts[1]);
+                read(prototype.points, counts[2]);
+                read(prototype.segments, 2 * counts[3]);
+                read(prototype.triangles, 3 * counts[4]);
+                read(prototype.triangle_normals, counts[5] ? 9 * counts[4] : 0);
+                for (const std::vector<uint32_t>* elements : {&prototype.points, &prototype.segments, &prototype.triangles}) {
+                    for (uint32_t index : *elements) {
+                        if (index >= counts[1]) return {};
+                    }
+                }
+                byte_count += size;
+                mesh.prototypes.push_back(std::move(prototype));
+            }
+        }
+        if (offset + byte_count > prizmb.size()) return {};
+        const char* items = prizmb.data() + offset;
+
+        auto read_floats = [&](std::vector<double>& values, int components) {
+            values.resize(item_count * components);
+            for (size_t i = 0; i < values.size(); i++) {
+                if (item_size == 4u * components) {
+                    float value;
+                    std::memcpy(&value, items + 4 * i, 4);
+                    values[i] = value;
+                } else {
+                    std::memcpy(&values[i], items + 8 * i, 8);
+                }
+            }
+        };
+        auto read_indices = [&](std::vector<uint32_t>& indices) {
+            indices.resize(byte_count / 4);
+            if (byte_count) std::memcpy(indices.data(), items, byte_count);
+        };
+
+        if (tag == "POSN") read_floats(mesh.positions, 3);
+        if (tag == "COLR") {
+            mesh.colors.resize(item_count * 3);
+            if (byte_count) std::memcpy(mesh.colors.data(), items, byte_count);
+            mesh.has_colors = true;
+        }
+        if (tag == "PNTS") read_indices(mesh.points);
+        if (tag == "SEGS") read_indices(mesh.segments);
+        if (tag == "TRIS") read_indices(mesh.triangles);
+        if (tag == "PNRM") read_floats(mesh.point_normals, 3);
+        if (tag == "SNRM") read_floats(mesh.segment_normals, 6);
+        if (tag == "TNRM") read_floats(mesh.triangle_normals, 9);
+        if (tag == "INST") {
+            mesh.instances.resize(item_count);
+            if (byte_count) std::memcpy(mesh.instances.data(), items, byte_count);
+        }
+
+        offset += byte_count + (8 - byte_count % 8) % 8;
+    }
+
+    // The attribute arrays must have an entry per vertex or element vertex
+    if (mesh.has_colors && mesh.colors.size() != mesh.positions.size()) return {};
+    if (!mesh.point_normals.empty() && mesh.point_normals.size() != 3 * mesh.points.size()) return {};
+    if (!mesh.segment_normals.empty() && mesh.segment_normals.size() != 3 * mesh.segments.size()) return {};
+    if (!mesh.triangle_normals.empty() && mesh.triangle_normals.size() != 3 * mesh.triangles.size()) return {};
+    for (const PrizmbMesh::Instance& instance : mesh.instances) {
+        if (instance.prototype >= mesh.prototypes.size()) return {};
+    }
+
+    // Write the OBJ text, using positive indices
+    std::string out;
+    char number[32];
+    auto write_number = [&](double value) {
+        out += ' ';
+        out.append(number, std::to_chars(number, number + sizeof(number), value).ptr);
+    };
+    auto write_index = [&](uint32_t index, size_t count) {
+        // A missing index is written as an index past the end, which is missing when it is read
+        write_number(static_cast<double>(index == prizmb_missing_index ? count + 1 : index + 1));
+    };
+    auto write_annotation = [&](const std::string* text) {
+        if (text) out += " # " + *text;
+    };
+
+    size_t vertex_count = mesh.positions.size() / 3;
+    std::vector<const std::string*> annotations[4];
+    annotations[PrizmbMesh::VERTEX].resize(vertex_count);
+    annotations[PrizmbMesh::POINT].resize(mesh.points.size());
+    annotations[PrizmbMesh::SEGMENT].resize(mesh.segments.size() / 2);
+    annotations[PrizmbMesh::TRIANGLE].resize(mesh.triangles.size() / 3);
+    for (const PrizmbMesh::Annotation& annotation : mesh.annotations) {
+        if (annotation.kind < 4 && annotation.id < annotations[annotation.kind].size()) {
+            annotations[annotation.kind][annotation.id] = &annotation.text;
+        }
+    }
+
+    size_t normal_count = 0;
+    auto write_elements = [&](const char* directive, const std::vector<uint32_t>& elements, const std::vector<double>& normals,
+                              size_t corners, const std::vector<const std::string*>& element_annotations, size_t count) {
+        for (size_t e = 0; e < elements.size() / corners; e++) {
+            if (!normals.empty()) {
+                for (size_t c = 0; c < corners; c++) {
+                    out += "\nvn";
+                    for (int d = 0; d < 3; d++) write_number(normals[3 * (corners * e + c) + d]);
+                }
+            }
+            out += '\n';
+            out += directive;
+            for (size_t c = 0; c < corners; c++) {
+                write_index(elements[corners * e + c], count);
+                if (!normals.empty()) {
+                    out += "//";
+                    out.append(number, std::to_chars(number, number + sizeof(number), normal_count + c + 1).ptr);
+                }
+            }
+            if (!normals.empty()) normal_count += corners;
+            if (e < element_annotations.size()) write_annotation(element_annotations[e]);
+        }
+    };
+
+    // The prototypes are written first, the viewer removes their vertices so they don't change the vertex indices.
+    // Each one is followed by its instances, in case a later prototype has the same name
+    for (uint32_t k = 0; k < mesh.prototypes.size(); k++) {
+        const PrizmbMesh::Prototype& prototype = mesh.prototypes[k];
+        out += "\nprototype " + prototype.name;
+        for (size_t i = 0; i < prototype.positions.size(); i++) {
+            if (i % 3 == 0) out += "\nv";
+            write_number(prototype.positions[i]);
+        }
+        size_t shape_vertex_count = prototype.positions.size() / 3;
+        write_elements("p", prototype.points, {}, 1, {}, shape_vertex_count);
+        write_elements("l", prototype.segments, {}, 2, {}, shape_vertex_count);
+        write_elements("f", prototype.triangles, prototype.triangle_normals, 3, {}, shape_vertex_count);
+        out += "\nprototype_end";
+        for (const PrizmbMesh::Instance& instance : mesh.instances) {
+            if (instance.prototype != k) continue;
+            out += "\ninstance " + prototype.name;
+            for (double value : instance.rows) write_number(value);
+            if (!std::isnan(instance.color[0])) {
+                for (float value : instance.color) write_number(value);
+            }
+        }
+    }
+
+    for (size_t v = 0; v < vertex_count; v++) {
+        out += "\nv";
+        for (int d = 0; d < 3; d++) write_number(mesh.positions[3 * v + d]);
+        if (mesh.has_colors && !std::isnan(mesh.colors[3 * v])) {
+            for (int d = 0; d < 3; d++) write_number(mesh.colors[3 * v + d]);
+        }
+        write_annotation(annotations[PrizmbMesh::VERTEX][v]);
+    }
+
+    write_elements("p", mesh.points, mesh.point_normals, 1, annotations[PrizmbMesh::POINT], vertex_count);
+    write_elements("l", mesh.segments, mesh.segment_normals, 2, annotations[PrizmbMesh::SEGMENT], vertex_count);
+    write_elements("f", mesh.triangles, mesh.triangle_normals, 3, annotations[PrizmbMesh::TRIANGLE], vertex_count);
+
+    // Separate the comment groups with blank lines so they are read as separate annotations
+    for (const PrizmbMesh::Annotation& annotation : mesh.annotations) {
+        if (annotation.kind == PrizmbMesh::BLOCK) {
+            out += '\n';
+            size_t begin = 0;
+            do {
+                size_t end = std::min(annotation.text.find('\n', begin), annotation.text.size());
+                out += "\n# ";
+                out.append(annotation.text, begin, end - begin);
+                begin = end + 1;
+            } while (begin <= annotation.text.size());
+            out += '\n';
+        } else if (annotation.kind == PrizmbMesh::COMMAND) {
+            out += "\n\n#! " + annotation.text + "\n";
+        }
+    }
+
+    return out;
+}
+
+std::vector<std::string> read_frames(const std::string& filename) {
+    std::ifstream file(filename, std::ifstream::binary);
+    std::stringstream stream;
+    stream << file.rdbuf();
+    std::string data = stream.str();
+
+    auto read_u64 = [&data](size_t offset) {
+        uint64_t value = 0;
+        for (int i = 0; i < 8; i++) value |= uint64_t(static_cast<unsigned char>(data[offset + i])) << (8 * i);
+        return value;
+    };
+    if (data.size() < 16 || data.compare(0, 8, "PRIZMFRM") != 0) return {};
+
+    // Frames end where the index begins, or at the end of the file if the index was not written
+    uint64_t frames_end = data.size();
+    if (data.size() >= 40 && data.compare(data.size() - 8, 8, "PRIZMIDX") == 0) {
+        frames_end = std::min<uint64_t>(read_u64(data.size() - 16), data.size());
+    }
+
+    std::vector<std::string> frames;
+    uint64_t offset = 16;
+    while (offset + 8 <= frames_end) {
+        uint64_t count = read_u64(offset);
+        if (count > frames_end - offset - 8) break; // Truncated frame
+        frames.push_back(data.substr(offset + 8, count));
+        offset += 8 + count;
+    }
+    return frames;
+}
+
+std::string obj_delta(std::string_view previous, std::string_view obj, const std::string& base_filename, uint64_t sequence) {
+    return obj_delta(prizmb_mesh_from_obj(previous), prizmb_mesh_from_obj(obj), base_filename, sequence);
+}
+
+std::string obj_delta(const PrizmbMesh& from, const PrizmbMesh& to, const std::string& base_filename, uint64_t sequence) {
+    size_t from_vertex_count = from.positions.size() / 3;
+    size_t to_vertex_count = to.positions.size() / 3;
+
+    std::string out = "# Prizm delta, see Prizm::DeltaWriter\nbase " + base_filename + " " + std::to_string(sequence);
+    for (size_t count : {from_vertex_count, from.points.size(), from.segments.size() / 2, from.triangles.size() / 3}) {
+        out += " " + std::to_string(count);
+    }
+    out += '\n';
+
+    char number[32];
+    auto write_number = [&](auto value) {
+        out += ' ';
+        out.append(number, std::to_chars(number, number + sizeof(number), value).ptr);
+    };
 
-    for (int face = 0; face < mesh->ntriangles; face++) {
-        PAR_SHAPES_T* tri = mesh->triangles + face * 3;
-        float* a = mesh->points + tri[0] * 3;
-        float* b = mesh->points + tri[1] * 3;
-        float* c = mesh->points + tri[2] * 3;
-        triangle3(V3(a[0], a[1], a[2]), V3(b[0], b[1], b[2]), V3(c[0], c[1], c[2])).newline();
+    if (to_vertex_count != from_vertex_count) {
+        out += "vertex_count " + std::to_string(to_vertex_count) + '\n';
+    }
+    auto color = [](const PrizmbMesh& mesh, size_t v, int d) {
+        return mesh.has_colors ? mesh.colors[3 * v + d] : std::numeric_limits<float>::quiet_NaN();
+    };
+    for (size_t v = 0; v < to_vertex_count; v++) {
+        bool changed = v >= from_vertex_count;
+        for (int d = 0; d < 3 && !changed; d++) {
+            float a = color(from, v, d), b = color(to, v, d);
+            changed = from.positions[3 * v + d] != to.positions[3 * v + d] || std::memcmp(&a, &b, sizeof(float)) != 0;
+        }
+        if (changed) {
+            out += 'v';
+            write_number(v + 1);
+            for (int d = 0; d < 3; d++) write_number(to.positions[3 * v + d]);
+            if (!std::isnan(color(to, v, 0))) {
+                for (int d = 0; d < 3; d++) write_number(color(to, v, d));
+            }
+            out += '\n';
+        }
     }
 
-    par_shapes_free_mesh(mesh);
+    // Elements are kept up to the first one which changed, then the rest are replaced
+    auto write_elements = [&](const char* kind, const char* directive, const std::vector<uint32_t>& a, const std::vector<uint32_t>& b, size_t corners) {
+        size_t kept = 0;
+        while (kept < a.size() && kept < b.size() && a[kept] == b[kept]) kept++;
+        if (kept == a.size() && kept == b.size()) return;
+        out += std::string(kind) + " " + std::to_string(kept / corners) + '\n';
+        for (size_t e = kept / corners; e < b.size() / corners; e++) {
+            out += directive;
+            for (size_t c = 0; c < corners; c++) {
+                uint32_t index = b[corners * e + c];
+                write_number(index == prizmb_missing_index ? to_vertex_count + 1 : size_t(index) + 1);
+            }
+            out += '\n';
+        }
+    };
+    write_elements("points", "p", from.points, to.points, 1);
+    write_elements("segments", "l", from.segments, to.segments, 2);
+    write_elements("triangles", "f", from.triangles, to.triangles, 3);
 
-    return *this;
+    return out;
 }
 
 // Obj& Obj::sphere3(V3f center, float radius, int segment_count, V3f rotation) {
@@ -0,0 +1,41 @@
+#include "Prizm.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+// Measures the throughput of points3, which formats coordinates with the DecimalKernel and ShortestKernel, for
+// coordinates which are random floats, random doubles and doubles with 3 decimals. Prints the best of a few runs
+template <typename T> static void benchmark(const char* name, const std::vector<T>& coords) {
+    double best_seconds = 0;
+    size_t bytes = 0;
+    for (int run = 0; run < 5; run++) {
+        auto start = std::chrono::steady_clock::now();
+        Prizm::Obj obj;
+        obj.set_use_negative_indices(false).points3(Prizm::strided<3>(coords.data(), static_cast<int>(coords.size() / 3)));
+        std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+        if (run == 0 || seconds.count() < best_seconds) best_seconds = seconds.count();
+        bytes = obj.size();
+    }
+    std::printf("points3 %-16s %6.1f ns/coordinate %7.1f MB/s\n", name, best_seconds * 1e9 / coords.size(), bytes / best_seconds / 1e6);
+}
+
+int main() {
+    constexpr int point_count = 2000000;
+    std::mt19937_64 rng(1);
+
+    std::vector<float> floats(3 * point_count);
+    std::uniform_real_distribution<float> float_distribution(-100, 100);
+    for (float& c : floats) c = float_distribution(rng);
+    benchmark("random floats", floats);
+
+    std::vector<double> doubles(3 * point_count);
+    std::uniform_real_distribution<double> double_distribution(-100, 100);
+    for (double& c : doubles) c = double_distribution(rng);
+    benchmark("random doubles", doubles);
+
+    for (double& c : doubles) c = std::round(c * 1000) / 1000;
+    benchmark("3 decimals", doubles);
+
+    return 0;
+}
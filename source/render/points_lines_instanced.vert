@@ -0,0 +1,29 @@
+#version 330 core
+
+// As points_lines.vert but the vertices are in prototype space and each instance has its own transform and color
+
+layout (location = 0) in vec3 in_vertex;
+layout (location = 3) in vec3 in_color; // Per instance
+layout (location = 4) in vec4 in_model_from_prototype_row0; // Per instance, the rows of an affine transform
+layout (location = 5) in vec4 in_model_from_prototype_row1;
+layout (location = 6) in vec4 in_model_from_prototype_row2;
+
+uniform mat4 world_from_model;
+uniform mat4 view_from_world;
+uniform mat4 clip_from_view;
+uniform float point_size;
+
+out vec3 fragment_position_ws;
+out vec3 fragment_color;
+
+void main() {
+    mat4 model_from_prototype = transpose(mat4(in_model_from_prototype_row0, in_model_from_prototype_row1, in_model_from_prototype_row2, vec4(0., 0., 0., 1.)));
+    mat4 world_from_prototype = world_from_model * model_from_prototype;
+    mat4 clip_from_prototype = clip_from_view * view_from_world * world_from_prototype;
+
+    fragment_position_ws = (world_from_prototype * vec4(in_vertex, 1.)).xyz;
+    fragment_color = in_color;
+
+    gl_Position = clip_from_prototype * vec4(in_vertex, 1.);
+    gl_PointSize = point_size;
+}
@@ -0,0 +1,40 @@
+#version 330 core
+
+// As triangles.vert but the vertices are in prototype space and each instance has its own transform and color
+
+layout (location = 0) in vec3 in_vertex;
+layout (location = 1) in vec3 in_normal;
+layout (location = 3) in vec3 in_color; // Per instance
+layout (location = 4) in vec4 in_model_from_prototype_row0; // Per instance, the rows of an affine transform
+layout (location = 5) in vec4 in_model_from_prototype_row1;
+layout (location = 6) in vec4 in_model_from_prototype_row2;
+
+uniform mat4 world_from_model;
+uniform mat4 view_from_world;
+uniform mat4 clip_from_view;
+
+out VS_Out {
+    vec3 vertex_normal_ws;
+    vec3 fragment_position_ws;
+    vec3 vertex_color;
+} vs_out;
+
+void main() {
+    mat4 model_from_prototype = transpose(mat4(in_model_from_prototype_row0, in_model_from_prototype_row1, in_model_from_prototype_row2, vec4(0., 0., 0., 1.)));
+    mat4 world_from_prototype = world_from_model * model_from_prototype;
+    mat4 clip_from_prototype = clip_from_view * view_from_world * world_from_prototype;
+
+    // Transform normals with the cofactor matrix, which is the inverse transpose up to scale and is also defined for
+    // flat instances (e.g., a zero scale in z)
+    mat3 m = mat3(world_from_prototype);
+    mat3 cofactor = mat3(cross(m[1], m[2]), cross(m[2], m[0]), cross(m[0], m[1]));
+    if (determinant(m) < 0.) {
+        cofactor = -cofactor;
+    }
+
+    vs_out.vertex_normal_ws = normalize(cofactor * in_normal);
+    vs_out.fragment_position_ws = (world_from_prototype * vec4(in_vertex, 1.)).xyz;
+    vs_out.vertex_color = in_color;
+
+    gl_Position = clip_from_prototype * vec4(in_vertex, 1.);
+}